@@ -66,6 +66,7 @@ class TokenRestAPIConan(ConanFile):
         self.requires.add("cppuri/1.0.0@tcsantanello/stable")
         self.requires.add("tokengov/1.0.0@tcsantanello/stable")
         self.requires.add("prometheus-cpp/0.11.0")
+        self.requires.add("libnghttp2/1.40.0")
 
     def export_sources(self):
         git = tools.Git(".")
@@ -3,6 +3,7 @@
 #define __TOKENIZATION_HTTP_BASE_HH__
 
 #include "executor.hh"
+#include "router.hh"
 #include <boost/asio.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
@@ -11,6 +12,7 @@
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
 #include <token/api.hh>
+#include <tuple>
 
 #define LOG( logger, lvl, ... )                                                                    \
   do {                                                                                             \
@@ -36,6 +38,67 @@ namespace token {
       using buffer_type     = beast::flat_buffer;
       using executor_type   = token::async::Executor;
       using shared_executor = std::shared_ptr< executor_type >;
+      using priority_type   = executor_type::priority_type;
+
+      /**
+       * @brief Where a route's handler runs
+       */
+      enum class Dispatch : uint8_t {
+        queued,    /**< On the executor, the handler may block */
+        immediate, /**< On the IO thread that read the request, the handler must not block */
+      };
+
+      /**
+       * @brief When a route's requests are checked (see RouteConfig::setGuard( ))
+       */
+      enum class Guard : uint8_t {
+        none,    /**< Not checked, the handler checks the whole request itself */
+        headers, /**< Checked on the headers alone, before the body is read */
+      };
+
+      /**
+       * @brief How a route's requests are handled; converts from any option alone
+       */
+      struct RouteOptions {
+        priority_type priority = priority_type::normal;
+        Dispatch      dispatch = Dispatch::queued;
+        Guard         guard    = Guard::none;
+
+        RouteOptions( ) = default;
+        RouteOptions( priority_type _priority )
+          : priority( _priority ) {}
+        RouteOptions( Dispatch _dispatch )
+          : dispatch( _dispatch ) {}
+        RouteOptions( Guard _guard )
+          : guard( _guard ) {}
+      };
+
+      /**
+       * @brief Consumer of a request body as it arrives, producing the response body as it goes
+       *
+       * Streaming routes (see RouteConfig::stream( )) hand each piece of the request body to
+       * the stream as it's read, on the executor, and send what it produces back as it's
+       * produced (chunked), so neither body need be held whole.
+       */
+      class BodyStream {
+       public:
+        virtual ~BodyStream( ) = default;
+
+        /**
+         * @brief Consume the next piece of the request body
+         * @param data request body piece
+         * @param out [out] response body to send so far, appended to
+         * @return false to stop, the request is in error; the response ends after out
+         */
+        virtual bool write( string_view data, std::string &out ) = 0;
+
+        /**
+         * @brief The request body is complete
+         * @param out [out] the rest of the response body, appended to
+         * @return false if the request is in error
+         */
+        virtual bool finish( std::string &out ) = 0;
+      };
 
       template < typename body_type = http::string_body,
                  typename Req       = http::request< body_type >,
@@ -43,10 +106,12 @@ namespace token {
       struct TypeTraits {
         using response_type  = Resp;
         using request_type   = Req;
-        using param_map_type = std::unordered_map< std::string, std::string >;
+        using param_map_type = PathParams;
         using handler_type =
           std::function< bool( param_map_type &, request_type &, response_type & ) >;
-        using route_type     = std::pair< std::string, handler_type >;
+        using stream_type = std::function< std::unique_ptr< BodyStream >(
+          param_map_type &, request_type &, response_type & ) >;
+        using route_type     = std::tuple< std::string, handler_type, RouteOptions, stream_type >;
         using route_map_type = std::unordered_multimap< http::verb, route_type >;
       };
 
@@ -0,0 +1,169 @@
+#ifndef __TOKENIZATION_HTTP_CONNECTION_HH__
+#define __TOKENIZATION_HTTP_CONNECTION_HH__
+
+#include <boost/beast/core/string.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace token {
+  namespace api {
+    namespace http {
+      /**
+       * @brief Per connection details, available to a route handler while it runs
+       *
+       * Handlers only see the request; the session publishes its connection for the duration of
+       * each handler call (see Connection::Scope), so handlers that care about the peer can ask
+       * for Connection::current( ).
+       *
+       * Keep-alive clients present the same credential on every request; the connection remembers
+       * a digest of the last one validated (see remember( )) so it needn't be validated again.
+       * The credential itself is never kept past the request that carried it.
+       */
+      class Connection {
+       public:
+        using clock_type    = std::chrono::steady_clock;
+        using time_type     = clock_type::time_point;
+        using duration_type = clock_type::duration;
+
+       private:
+        /** Last credential validated over this connection */
+        struct memo_type {
+          std::string digest;         /**< Credential digest, never the credential */
+          uint32_t    identity   = 0; /**< Who it identified, 0 if nobody          */
+          uint64_t    generation = 0; /**< Credential generation it was from        */
+          time_type   expire;         /**< Revalidate after                         */
+        };
+
+        const std::string &     local;
+        const std::string &     remote;
+        std::mutex              memoLock;
+        memo_type               memo;
+
+        static Connection *&active( ) {
+          static thread_local Connection *connection = nullptr;
+          return connection;
+        }
+
+       public:
+        Connection( const std::string &_local, const std::string &_remote )
+          : local( _local )
+          , remote( _remote ) {}
+
+        Connection( const Connection & ) = delete;
+        Connection &operator=( const Connection & ) = delete;
+
+        /**
+         * @brief Get the local address, as a string
+         * @return ip and port as a string
+         */
+        const std::string &address_local( ) const { return local; }
+
+        /**
+         * @brief Get the remote address, as a string
+         * @return ip and port as a string
+         */
+        const std::string &address_remote( ) const { return remote; }
+
+        /**
+         * @brief Get the remote host, without the port
+         * @return ip (v6 addresses remain bracketed)
+         */
+        std::string host_remote( ) const {
+          auto colon = remote.rfind( ':' );
+          return ( colon == std::string::npos ) ? remote : remote.substr( 0, colon );
+        }
+
+        /**
+         * @brief Recall who a credential identified, if it was the last validated here
+         * @param digest digest of the credential presented with the current request
+         * @param generation current credential generation; a remembered credential from any
+         *                   other generation is forgotten (e.g. the user changed)
+         * @return identity, 0 if the credential must be validated
+         */
+        uint32_t recall( boost::beast::string_view digest, uint64_t generation ) {
+          std::lock_guard< std::mutex > guard( memoLock );
+
+          if ( !memo.identity ) {
+            return 0;
+          }
+
+          if ( ( memo.generation != generation ) || ( memo.expire < clock_type::now( ) ) ) {
+            forget( );
+            return 0;
+          }
+
+          if ( memo.digest.size( ) != digest.size( ) ) {
+            return 0;
+          }
+
+          uint8_t diff = 0; // Don't leak how much of the digest matched
+
+          for ( size_t pos = 0; pos < digest.size( ); ++pos ) {
+            diff |= memo.digest[ pos ] ^ digest[ pos ];
+          }
+
+          return diff ? 0 : memo.identity;
+        }
+
+        /**
+         * @brief Remember a validated credential, by its digest
+         * @param digest digest of the credential presented with the current request (a keyed or
+         *               cryptographic hash; the credential itself must not be given)
+         * @param identity who it identified
+         * @param generation credential generation it was validated against
+         * @param ttl how long before it must be validated again
+         */
+        void remember( boost::beast::string_view digest,
+                       uint32_t                  identity,
+                       uint64_t                  generation,
+                       duration_type             ttl ) {
+          std::lock_guard< std::mutex > guard( memoLock );
+
+          if ( ttl <= duration_type::zero( ) ) {
+            return;
+          }
+
+          memo.digest.assign( digest.data( ), digest.size( ) );
+          memo.identity   = identity;
+          memo.generation = generation;
+          memo.expire     = clock_type::now( ) + ttl;
+        }
+
+        /**
+         * @brief Get the connection whose request is being handled on this thread
+         * @return connection, or null outside of a handler
+         */
+        static Connection *current( ) { return active( ); }
+
+        /**
+         * @brief Publish a connection to the handler running on this thread
+         */
+        class Scope {
+          Connection *prior;
+
+         public:
+          explicit Scope( Connection &connection )
+            : prior( active( ) ) {
+            active( ) = &connection;
+          }
+          ~Scope( ) { active( ) = prior; }
+
+          Scope( const Scope & ) = delete;
+          Scope &operator=( const Scope & ) = delete;
+        };
+
+       private:
+        /** memoLock must be held */
+        void forget( ) {
+          memo.digest.clear( );
+          memo.identity   = 0;
+          memo.generation = 0;
+        }
+      };
+    } // namespace http
+  }   // namespace api
+} // namespace token
+
+#endif //__TOKENIZATION_HTTP_CONNECTION_HH__
@@ -20,6 +20,9 @@ namespace token {
         using response_type       = typename Traits::response_type;
         using request_type        = typename Traits::request_type;
         using handler_type        = typename Traits::handler_type;
+#ifdef SO_REUSEPORT
+        using reuse_port = networking::detail::socket_option::boolean< SOL_SOCKET, SO_REUSEPORT >;
+#endif
 
         acceptor_type                      acceptor;
         networking::ssl::context *         ctx;
@@ -81,20 +84,38 @@ namespace token {
         }
 
        public:
+        /**
+         * @param _io io service accepted sessions run on
+         * @param _rc route configuration
+         * @param _ctx ssl context, null for plain connections only
+         * @param ep endpoint to listen on
+         * @param _executor request executor
+         * @param shared share the port with other listeners (SO_REUSEPORT), the kernel spreads
+         *               the connections between them
+         */
         Listener( std::shared_ptr< io_service_type > &&_io,
                   std::shared_ptr< config_type > &&    _rc,
                   networking::ssl::context *           _ctx,
                   endpoint_type &&                     ep,
-                  std::shared_ptr< executor_type > &   _executor )
-          : acceptor( acceptor_type{ *_io, ep } )
+                  std::shared_ptr< executor_type > &   _executor,
+                  bool                                 shared = false )
+          : acceptor( *_io )
           , ctx( _ctx )
           , io( _io )
           , rc( _rc )
           , executor( _executor )
           , logger( token::api::create_logger( TOKEN_API_HTTP_LISTENER_LOG_ID, { } ) ) {
-          beast::error_code ec;
-          acceptor.set_option( networking::socket_base::reuse_address( true ), ec );
-          acceptor.listen( networking::socket_base::max_listen_connections, ec );
+          acceptor.open( ep.protocol( ) );
+          acceptor.set_option( networking::socket_base::reuse_address( true ) );
+
+#ifdef SO_REUSEPORT
+          if ( shared ) {
+            acceptor.set_option( reuse_port( true ) );
+          }
+#endif
+
+          acceptor.bind( ep );
+          acceptor.listen( networking::socket_base::max_listen_connections );
           LOG( logger, info, "Created listener on {}", address_format( ep ) );
         }
 
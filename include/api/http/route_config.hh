@@ -3,6 +3,7 @@
 #define __TOKENIZATION_ROUTE_CONFIG_HH__
 
 #include "base.hh"
+#include <mutex>
 
 namespace token {
   namespace api {
@@ -15,103 +16,248 @@ namespace token {
         using param_map_type = typename Traits::param_map_type;
         using route_type     = typename Traits::route_type;
         using route_map      = typename Traits::route_map_type;
+        using stream_type    = typename Traits::stream_type;
+        using tree_type      = RouteTree< const route_type * >;
+        using dispatch_type  = std::function< executor_type *( const param_map_type & ) >;
+        using flow_type      = executor_type::flow_type;
+        using requester_type = std::function< flow_type( request_type & ) >;
 
-        route_map    routes;
-        handler_type defaultHandler;
+        std::mutex                         routeLock; /**< Guards routes, and building the lookup */
+        route_map                          routes;
+        handler_type                       defaultHandler;
+        handler_type                       guard;
+        std::shared_ptr< const tree_type > compiled; /**< Published with atomic_store */
+        dispatch_type                      dispatcher;
+        requester_type                     requester;
+        size_t                             pipeline = 1;
+        size_t                             streams  = 0;
 
        protected:
         std::shared_ptr< spdlog::logger > logger;
 
-        void addRoute( verbs verb, const std::string &resource, handler_type handler ) {
-          routes.insert( std::make_pair( verb, std::make_pair( resource, std::move( handler ) ) ) );
+        void addRoute( verbs              verb,
+                       const std::string &resource,
+                       handler_type       handler,
+                       RouteOptions       options,
+                       stream_type        stream = stream_type( ) ) {
+          std::lock_guard< std::mutex > lock( routeLock );
+
+          routes.insert( std::make_pair(
+            verb, route_type( resource, std::move( handler ), options, std::move( stream ) ) ) );
+          std::atomic_store( &compiled, std::shared_ptr< const tree_type >( ) );
+        }
+
+        /**
+         * @brief Build and publish the route lookup; routeLock must be held
+         * @return route lookup
+         */
+        std::shared_ptr< const tree_type > build( ) {
+          auto tree = std::make_shared< tree_type >( );
+
+          // Routes are never removed, and map nodes don't move, so the lookup's pointers hold
+          for ( auto &route : routes ) {
+            tree->insert( route.first, std::get< 0 >( route.second ), &route.second );
+          }
+
+          std::shared_ptr< const tree_type > result( std::move( tree ) );
+          std::atomic_store( &compiled, result );
+          return result;
         }
 
        public:
-        void get( const std::string &resource, handler_type handler ) {
-          addRoute( verbs::get, resource, std::move( handler ) );
+        /*
+         * Routes are queued for the workers with the given priority; control plane routes
+         * (health checks, metrics) should be registered as priority_type::high so they are
+         * served ahead of, and aren't shed with, the data plane.  Routes whose handlers never
+         * block may instead be registered as Dispatch::immediate, to be handled on the IO
+         * thread without a trip through the queues.
+         */
+
+        void get( const std::string &resource,
+                  handler_type       handler,
+                  RouteOptions       options = RouteOptions( ) ) {
+          addRoute( verbs::get, resource, std::move( handler ), options );
         }
 
-        void put( const std::string &resource, handler_type handler ) {
-          addRoute( verbs::put, resource, std::move( handler ) );
+        void put( const std::string &resource,
+                  handler_type       handler,
+                  RouteOptions       options = RouteOptions( ) ) {
+          addRoute( verbs::put, resource, std::move( handler ), options );
         }
 
-        void post( const std::string &resource, handler_type handler ) {
-          addRoute( verbs::post, resource, std::move( handler ) );
+        void post( const std::string &resource,
+                   handler_type       handler,
+                   RouteOptions       options = RouteOptions( ) ) {
+          addRoute( verbs::post, resource, std::move( handler ), options );
         }
 
-        void del( const std::string &resource, handler_type handler ) {
-          addRoute( verbs::delete_, resource, std::move( handler ) );
+        void del( const std::string &resource,
+                  handler_type       handler,
+                  RouteOptions       options = RouteOptions( ) ) {
+          addRoute( verbs::delete_, resource, std::move( handler ), options );
+        }
+
+        /**
+         * @brief Add a streaming route; its request body is handed to a stream as it's read, on
+         *        the executor, and the response body is sent (chunked) as it's produced
+         * @param verb http method
+         * @param resource route
+         * @param open given the request headers, sets up the response (status, headers) and
+         *             returns the stream, or null to answer with the response as it was set;
+         *             it runs on the IO thread, so it must not block
+         * @param options route options
+         * @note where a body can't be streamed (HTTP/2) it's read whole, then handed to the
+         *       stream in one piece
+         */
+        void stream( verbs              verb,
+                     const std::string &resource,
+                     stream_type        open,
+                     RouteOptions       options = RouteOptions( ) ) {
+          auto handler = [ open ]( param_map_type &params,
+                                   request_type &  request,
+                                   response_type & response ) {
+            auto        stream = open( params, request, response );
+            std::string out;
+
+            if ( stream ) {
+              auto done        = stream->write( request.body( ), out ) && stream->finish( out );
+              response.body( ) = std::move( out );
+              return done;
+            }
+
+            return true;
+          };
+
+          addRoute( verb, resource, std::move( handler ), options, std::move( open ) );
         }
 
         void         setDefault( handler_type handler ) { defaultHandler = std::move( handler ); }
         handler_type getDefault( ) { return defaultHandler; }
 
-        using route_parsed = std::pair< std::vector< std::string >, handler_type >;
-
-        handler_type getRoute( verbs verb, std::string resource, param_map_type &params ) {
-          auto range = routes.equal_range( verb );
-          auto last  = std::unique( // Sort out & remove double '/'
-            resource.begin( ),
-            resource.end( ),
-            []( const std::string::value_type &lhs, const std::string::value_type &rhs ) -> bool {
-              return ( ( lhs == '/' ) && ( rhs == '/' ) );
-            } );
-
-          last -= *( last - 1 ) == '/'; // Remove trailing too
-          resource.erase( last, resource.end( ) );
-
-          for ( auto route = range.first; route != range.second; ++route ) {
-            if ( route->first == verb ) {
-              param_map_type _p;
-              const auto &   entry          = route->second;
-              auto &         entry_resource = entry.first;
-              auto           er_begin       = entry_resource.begin( );
-              auto           iter           = resource.begin( );
-
-              do {
-                auto set = std::mismatch( er_begin, entry_resource.end( ), iter );
-
-                // Come to the end of the registered resource
-                if ( set.first == entry_resource.end( ) ) {
-                  // ... and the submitted request path
-                  if ( set.second == resource.end( ) ) {
-                    // Yay, we found it!
-                    params = std::move( _p );
-                    return entry.second;
-                  }
-                  break;
-                }
-
-                if ( *set.first != '{' ) {
-                  break;
-                } else if ( *( set.first - 1 ) != '/' ) {
-                  break;
-                } else if ( *( set.second - 1 ) != '/' ) {
-                  break;
-                } else {
-                  auto end = std::find( set.first + 1, entry_resource.end( ), '}' );
-
-                  if ( end == entry_resource.end( ) ) {
-                    goto next;
-                  }
-
-                  auto anchor = std::string( set.first + 1, end );
-                  auto slash  = std::find( set.second, resource.end( ), '/' );
-
-                  er_begin = end + 1;
-                  iter     = slash;
-
-                  assert( er_begin == entry_resource.end( ) || *er_begin == '/' );
-                  assert( iter == resource.end( ) || *iter == '/' );
-
-                  _p[ anchor ] = std::string( set.second, slash );
-                }
-              } while ( true );
-            next:;
-            }
+        /**
+         * @brief Set the check of guarded (Guard::headers) routes' requests, e.g. authentication
+         *        and rate limiting; it's run on the executor with just the request headers, so
+         *        requests it turns away never have their bodies read (nor 100-continue sent)
+         * @param check given the request headers (no body), returns true to read the body and
+         *              handle the request, or false to answer with the response as it was set
+         * @note the handlers of guarded routes only see requests the check passed
+         */
+        void                setGuard( handler_type check ) { guard = std::move( check ); }
+        const handler_type &getGuard( ) const { return guard; }
+
+        /**
+         * @brief Choose the executor of matched requests, e.g. by a path parameter
+         * @param dispatch given a request's path parameters, returns the executor to handle it
+         *                 on, or null for the service's executor; the executor must outlive the
+         *                 service
+         * @note configure before starting the service
+         */
+        void setDispatch( dispatch_type dispatch ) { dispatcher = std::move( dispatch ); }
+
+        /**
+         * @brief Identify who requests are made for, so the executor shares its workers fairly
+         *        between them (see Executor::weigh( ))
+         * @param identify given the request headers, returns who it's for (e.g. a user id), 0 if
+         *                 unknown; it's run on the IO thread, before the request is checked or
+         *                 handled, so it must not block (e.g. consult only what's cached)
+         * @note configure before starting the service
+         */
+        void setRequester( requester_type identify ) { requester = std::move( identify ); }
+
+        /**
+         * @brief Set how many requests a session may handle at once (HTTP/1.1 pipelining);
+         *        responses are still written in request order
+         * @param depth requests read ahead of their responses, at least 1
+         */
+        void   setPipeline( size_t depth ) { pipeline = std::max< size_t >( depth, 1 ); }
+        size_t getPipeline( ) const { return pipeline; }
+
+        /**
+         * @brief Set how many requests an HTTP/2 connection may have in flight at once; HTTP/2
+         *        is offered (ALPN "h2", h2c prior knowledge) only when set
+         * @param count concurrent streams per connection, 0 for HTTP/1.1 only
+         * @note configure before adding listeners
+         */
+        void   setStreams( size_t count ) { streams = count; }
+        size_t getStreams( ) const { return streams; }
+
+        /**
+         * @brief Get the executor to handle a matched request on
+         * @param params path parameters
+         * @return executor, null for the service's executor
+         */
+        executor_type *getExecutor( const param_map_type &params ) const {
+          return dispatcher ? dispatcher( params ) : nullptr;
+        }
+
+        /**
+         * @brief Get who a request is made for, its executor flow
+         * @param request request headers
+         * @return flow, 0 if unknown
+         */
+        flow_type getFlow( request_type &request ) const {
+          return requester ? requester( request ) : 0;
+        }
+
+        /**
+         * @brief Build the route lookup from the registered routes
+         * @note the service does this on start; adding a route afterwards discards the lookup,
+         *       which is then rebuilt by the next getRoute( )
+         * @return route lookup
+         */
+        std::shared_ptr< const tree_type > compile( ) {
+          std::lock_guard< std::mutex > lock( routeLock );
+          return build( );
+        }
+
+        /**
+         * @brief Find the route for a request
+         * @param verb http method
+         * @param resource request target
+         * @param params [out] path parameters, referencing resource
+         * @return route, null if none matches
+         */
+        const route_type *findRoute( verbs verb, string_view resource, param_map_type &params ) {
+          auto tree = std::atomic_load( &compiled );
+
+          if ( !tree ) {
+            std::lock_guard< std::mutex > lock( routeLock );
+
+            // Another thread may have rebuilt it while this one waited
+            tree = std::atomic_load( &compiled );
+            tree = tree ? tree : build( );
+          }
+
+          auto route = tree->find( verb, resource, params );
+          return route ? *route : nullptr;
+        }
+
+        /**
+         * @brief Find the handler for a request
+         * @param verb http method
+         * @param resource request target
+         * @param params [out] path parameters, referencing resource
+         * @param options [out] route options
+         * @return route handler, or the default handler if no route matches
+         */
+        handler_type getRoute( verbs           verb,
+                               string_view     resource,
+                               param_map_type &params,
+                               RouteOptions &  options ) {
+          auto route = findRoute( verb, resource, params );
+
+          if ( !route ) {
+            options = RouteOptions( );
+            return defaultHandler;
           }
 
-          return defaultHandler;
+          options = std::get< 2 >( *route );
+          return std::get< 1 >( *route );
+        }
+
+        handler_type getRoute( verbs verb, string_view resource, param_map_type &params ) {
+          RouteOptions options;
+          return getRoute( verb, resource, params, options );
         }
       };
     } // namespace http
@@ -0,0 +1,213 @@
+#ifndef __TOKENIZATION_HTTP_ROUTER_HH__
+#define __TOKENIZATION_HTTP_ROUTER_HH__
+
+#include <boost/beast/core/string.hpp>
+#include <boost/beast/http/verb.hpp>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace token {
+  namespace api {
+    namespace http {
+      using string_view = boost::beast::string_view;
+
+      /**
+       * @brief Path parameters captured by a route match
+       *
+       * Names reference the registered route and values reference the request target; nothing
+       * is copied, so the parameters are only valid while both the route configuration and the
+       * request are.
+       */
+      class PathParams {
+       public:
+        using value_type     = std::pair< string_view, string_view >;
+        using container_type = std::vector< value_type >;
+        using const_iterator = container_type::const_iterator;
+
+       private:
+        container_type values;
+
+       public:
+        /**
+         * @brief Get a parameter value
+         * @param name parameter name (as in "{name}" in the route)
+         * @return parameter value, empty if not captured
+         */
+        string_view operator[]( string_view name ) const {
+          for ( auto &value : values ) {
+            if ( value.first == name ) {
+              return value.second;
+            }
+          }
+
+          return string_view{ };
+        }
+
+        /**
+         * @brief Capture a parameter value
+         * @param name parameter name
+         * @param value parameter value
+         */
+        void push( string_view name, string_view value ) { values.emplace_back( name, value ); }
+
+        /**
+         * @brief Discard the most recently captured value
+         */
+        void pop( ) { values.pop_back( ); }
+
+        void           clear( ) { values.clear( ); }
+        bool           empty( ) const { return values.empty( ); }
+        size_t         size( ) const { return values.size( ); }
+        const_iterator begin( ) const { return values.begin( ); }
+        const_iterator end( ) const { return values.end( ); }
+      };
+
+      /**
+       * @brief Compiled route lookup; a tree of path segments
+       *
+       * Each level of the tree is one path segment; a lookup walks the request target a segment
+       * at a time, preferring literal segments over "{parameter}" segments, so its cost depends
+       * on the depth of the path rather than on the number of routes.  Empty segments (doubled
+       * or trailing slashes) are ignored, as is any query string.
+       *
+       * Segment text is referenced, not copied; the registered resource strings must outlive the
+       * tree.
+       */
+      template < typename handler_type >
+      class RouteTree {
+        using verb_type = boost::beast::http::verb;
+
+        struct node_type {
+          using child_type = std::pair< string_view, std::unique_ptr< node_type > >;
+
+          std::vector< child_type >                           literals;
+          std::vector< child_type >                           parameters;
+          std::vector< std::pair< verb_type, handler_type > > handlers;
+
+          node_type &child( std::vector< child_type > &children, string_view segment ) {
+            for ( auto &entry : children ) {
+              if ( entry.first == segment ) {
+                return *entry.second;
+              }
+            }
+
+            children.emplace_back( segment, std::unique_ptr< node_type >( new node_type ) );
+            return *children.back( ).second;
+          }
+        };
+
+        node_type root;
+
+        /**
+         * @brief Split off the next non-empty segment
+         * @param path [in/out] remaining path, advanced past the segment
+         * @param segment [out] segment
+         * @return false at the end of the path
+         */
+        static bool next( string_view &path, string_view &segment ) {
+          auto start = path.find_first_not_of( '/' );
+
+          if ( start == string_view::npos ) {
+            return false;
+          }
+
+          auto end = path.find( '/', start );
+
+          if ( end == string_view::npos ) {
+            segment = path.substr( start );
+            path    = string_view{ };
+          } else {
+            segment = path.substr( start, end - start );
+            path    = path.substr( end );
+          }
+
+          return true;
+        }
+
+        static const handler_type *match( const node_type &node,
+                                          verb_type        verb,
+                                          string_view      path,
+                                          PathParams &     params ) {
+          string_view segment;
+
+          if ( !next( path, segment ) ) {
+            for ( auto &entry : node.handlers ) {
+              if ( entry.first == verb ) {
+                return &entry.second;
+              }
+            }
+
+            return nullptr;
+          }
+
+          for ( auto &entry : node.literals ) {
+            if ( entry.first == segment ) {
+              if ( auto handler = match( *entry.second, verb, path, params ) ) {
+                return handler;
+              }
+              break;
+            }
+          }
+
+          for ( auto &entry : node.parameters ) {
+            params.push( entry.first, segment );
+
+            if ( auto handler = match( *entry.second, verb, path, params ) ) {
+              return handler;
+            }
+
+            params.pop( );
+          }
+
+          return nullptr;
+        }
+
+       public:
+        /**
+         * @brief Add a route
+         * @param verb http method
+         * @param resource resource path, "{name}" segments capture a path parameter
+         * @param handler route handler; the first handler added for a verb and path wins
+         */
+        void insert( verb_type verb, const std::string &resource, handler_type handler ) {
+          node_type * node = &root;
+          string_view path( resource );
+          string_view segment;
+
+          while ( next( path, segment ) ) {
+            if ( ( segment.size( ) > 2 ) && ( segment.front( ) == '{' ) &&
+                 ( segment.back( ) == '}' ) ) {
+              node = &node->child( node->parameters, segment.substr( 1, segment.size( ) - 2 ) );
+            } else {
+              node = &node->child( node->literals, segment );
+            }
+          }
+
+          for ( auto &entry : node->handlers ) {
+            if ( entry.first == verb ) {
+              return;
+            }
+          }
+
+          node->handlers.emplace_back( verb, std::move( handler ) );
+        }
+
+        /**
+         * @brief Look up the handler for a request
+         * @param verb http method
+         * @param target request target (path, with or without a query string)
+         * @param params [out] captured path parameters
+         * @return handler, or null if no route matches
+         */
+        const handler_type *find( verb_type verb, string_view target, PathParams &params ) const {
+          params.clear( );
+          return match( root, verb, target.substr( 0, target.find( '?' ) ), params );
+        }
+      };
+    } // namespace http
+  }   // namespace api
+} // namespace token
+
+#endif //__TOKENIZATION_HTTP_ROUTER_HH__
@@ -5,6 +5,9 @@
 #include "base.hh"
 #include "listener.hh"
 #include "route_config.hh"
+#ifdef __linux__
+#include <pthread.h>
+#endif
 
 namespace token {
   namespace api {
@@ -29,6 +32,9 @@ namespace token {
         thread_group                     threads;
         bool                             running     = false;
         int                              threadCount = 0;
+        /** Per thread io services, each thread with its own listeners; empty if shared */
+        std::vector< std::unique_ptr< io_service_type > > contexts;
+        bool                                              pinned = false;
 
         void thread_main( ) {
           while ( running ) {
@@ -36,6 +42,35 @@ namespace token {
           }
         }
 
+        void context_main( size_t index ) {
+          if ( pinned ) {
+            pin( index );
+          }
+
+          while ( running ) {
+            contexts[ index ]->run( );
+          }
+        }
+
+        /**
+         * @brief Pin the calling thread to a core
+         * @param index thread index, cores are assigned in turn
+         */
+        void pin( size_t index ) {
+#ifdef __linux__
+          cpu_set_t cpus;
+
+          CPU_ZERO( &cpus );
+          CPU_SET( index % std::max( std::thread::hardware_concurrency( ), 1u ), &cpus );
+
+          if ( pthread_setaffinity_np( pthread_self( ), sizeof( cpus ), &cpus ) != 0 ) {
+            LOG( this->logger, warn, "Failed to pin IO thread {} to a core", index );
+          }
+#else
+          LOG( this->logger, warn, "IO threads can't be pinned to cores on this platform" );
+#endif
+        }
+
         void init( std::shared_ptr< executor_type > executor, int threadCount ) {
           this->logger = token::api::create_logger( TOKEN_API_HTTP_SERVICE_LOG_ID, { } );
 
@@ -67,13 +102,45 @@ namespace token {
           init( executor, threadCount );
         }
 
+        /**
+         * @brief Give each IO thread an io service, and listeners, of its own
+         *
+         * Rather than every thread serving every connection from one shared io service, each
+         * thread accepts connections on its own listener (the kernel spreading new connections
+         * between them, see SO_REUSEPORT) and keeps them; a connection's IO stays on one thread,
+         * and on one core if pinned.
+         *
+         * @param pin pin each thread to a core
+         * @note call before adding listeners
+         */
+        void setPerThread( bool pin = false ) {
+#ifdef SO_REUSEPORT
+          pinned = pin;
+
+          while ( contexts.size( ) < static_cast< size_t >( threadCount ) ) {
+            contexts.emplace_back( new io_service_type( 1 ) );
+          }
+#else
+          LOG( this->logger, warn, "Ports can't be shared here, IO threads remain shared" );
+#endif
+        }
+
         void start( ) {
           if ( !running ) {
             running = true;
 
-            for ( auto num = 0; num < threadCount; ++num ) {
-              threads.emplace_back(
-                std::thread( std::bind( &Service::thread_main, this->shared_from_this( ) ) ) );
+            this->compile( );
+
+            if ( contexts.empty( ) ) {
+              for ( auto num = 0; num < threadCount; ++num ) {
+                threads.emplace_back(
+                  std::thread( std::bind( &Service::thread_main, this->shared_from_this( ) ) ) );
+              }
+            } else {
+              for ( size_t num = 0; num < contexts.size( ); ++num ) {
+                threads.emplace_back( std::thread(
+                  std::bind( &Service::context_main, this->shared_from_this( ), num ) ) );
+              }
             }
 
             LOG( this->logger, trace, "Started {} threads", threadCount );
@@ -106,13 +173,30 @@ namespace token {
             boost::asio::ip::tcp::resolver::passive | boost::asio::ip::tcp::resolver::v4_mapped |
               boost::asio::ip::tcp::resolver::all_matching );
 
-          std::make_shared< listener_type >(
-            std::shared_ptr< io_service_type >( this->shared_from_this( ), &ioc ),
-            std::dynamic_pointer_cast< config_type >( this->shared_from_this( ) ),
-            ctx,
-            resolved->endpoint( ),
-            executor )
-            ->start( );
+          if ( ( ctx ) && ( this->getStreams( ) ) ) {
+            advertise_http2( *ctx );
+          }
+
+          for ( auto &context : contexts ) {
+            std::make_shared< listener_type >(
+              std::shared_ptr< io_service_type >( this->shared_from_this( ), context.get( ) ),
+              std::dynamic_pointer_cast< config_type >( this->shared_from_this( ) ),
+              ctx,
+              resolved->endpoint( ),
+              executor,
+              true )
+              ->start( );
+          }
+
+          if ( contexts.empty( ) ) {
+            std::make_shared< listener_type >(
+              std::shared_ptr< io_service_type >( this->shared_from_this( ), &ioc ),
+              std::dynamic_pointer_cast< config_type >( this->shared_from_this( ) ),
+              ctx,
+              resolved->endpoint( ),
+              executor )
+              ->start( );
+          }
         }
 
         void addListener( const std::string &       address,
@@ -4,6 +4,7 @@
 
 #include "session/basic.hh"
 #include "session/detect.hh"
+#include "session/http2.hh"
 #include "session/plain.hh"
 #include "session/secure.hh"
 
@@ -1,11 +1,14 @@
 #ifndef __SESSION_BASIC_H_
 #define __SESSION_BASIC_H_
 
+#include "api/http/connection.hh"
 #include "api/http/route_config.hh"
 #include <boost/asio.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast.hpp>
+#include <deque>
+#include <limits>
 #include <spdlog/spdlog.h>
 
 #ifndef LOG
@@ -22,8 +25,14 @@ namespace token {
     namespace http {
 #define TOKEN_API_HTTP_SESSION_LOG_ID "token::api::http::session"
 
+      template < class session_type, typename traits >
+      class Http2;
+
       template < class sub_type, typename traits = DefaultTypeTraits >
       class Session {
+        template < class, typename >
+        friend class Http2;
+
        public:
         using self_type      = Session< sub_type, traits >;
         using config_type    = RouteConfig< traits >;
@@ -33,6 +42,43 @@ namespace token {
         using route_type     = typename traits::route_type;
         using route_map      = typename traits::route_map_type;
         using param_map_type = typename traits::param_map_type;
+        using pending_type   = std::deque< std::shared_ptr< response_type > >;
+        using http2_type     = Http2< sub_type, traits >;
+        using stream_type    = typename traits::stream_type;
+        using parser_type    = http::request_parser< typename request_type::body_type >;
+        using writer_type    = http::response_serializer< typename response_type::body_type >;
+
+        /**
+         * @brief A request, as it is read, checked and handled
+         */
+        struct exchange_type {
+          size_t                          seq = 0;         /**< Number (HTTP/2 stream id) */
+          parser_type                     parser;          /**< Reads it, request is its message */
+          std::shared_ptr< request_type > request;         /**< Headers, then body */
+          handler_type                    handler;         /**< Matched route handler */
+          param_map_type                  params;          /**< Matched path parameters */
+          RouteOptions                    options;         /**< Matched route options */
+          stream_type                     open;            /**< Matched route's stream, if any */
+          bool                            checked = false; /**< Headers checked, see guard( ) */
+          executor_type::flow_type        flow    = 0;     /**< Who it's for, see identify( ) */
+
+          /* Handling, see dispatch( ), and streaming (HTTP/1.1), see stream_begin( ) */
+          executor_type *                  pool = nullptr;  /**< Executor it's handled on */
+          executor_type::time_type         queued;          /**< When queued for the workers */
+          std::unique_ptr< BodyStream >    stream;          /**< Consumes the body */
+          std::shared_ptr< response_type > response;        /**< Response (headers if streamed) */
+          std::unique_ptr< writer_type >   writer;          /**< Writes the response headers */
+          std::string                      out;             /**< Response body being written */
+          bool                             last   = false;  /**< Nothing more to write */
+          bool                             failed = false;  /**< Stopped on an error */
+          bool                             ended  = false;  /**< Response complete */
+        };
+
+        /** Largest request body read whole (beast's default); streamed bodies have no limit */
+        static constexpr size_t body_limit = 1024 * 1024;
+
+        /** Largest response body storage kept for the next response, see recycled( ) */
+        static constexpr size_t spare_limit = 64 * 1024;
 
         Session( buffer_type &&                    _buffer,
                  socket_type &&                    _sock,
@@ -49,7 +95,8 @@ namespace token {
           , executor( std::move( _exec ) )
           , logger( std::move( _logger ) )
           , local( std::move( _local ) )
-          , remote( std::move( _remote ) ) {}
+          , remote( std::move( _remote ) )
+          , connection( local, remote ) {}
 
         Session( io_service_type *                io,
                  std::shared_ptr< config_type >   _rc,
@@ -58,7 +105,8 @@ namespace token {
           , strand( *io )
           , route_config( std::move( _rc ) )
           , executor( std::move( _executor ) )
-          , logger( token::api::create_logger( TOKEN_API_HTTP_SESSION_LOG_ID, { } ) ) {}
+          , logger( token::api::create_logger( TOKEN_API_HTTP_SESSION_LOG_ID, { } ) )
+          , connection( local, remote ) {}
 
         socket_type &               socket( ) { return sock; }
         sub_type &                  subclass( ) { return static_cast< sub_type & >( *this ); }
@@ -82,6 +130,25 @@ namespace token {
          */
         virtual void start( ) { perform_read( ); }
 
+        /*
+         * Pipelining: requests are read ahead while fewer than the route configuration's
+         * pipeline depth are awaiting a response, and are handled concurrently; each is numbered
+         * as it is read and the responses are written strictly in that order (see complete( )).
+         * All of the pipeline state is only touched on the strand.
+         *
+         * HTTP/2: once a session is upgraded (see upgrade( )) its requests are numbered by
+         * stream instead, and responses go to the HTTP/2 protocol handler as they complete.
+         *
+         * Requests are read in two phases, headers then body.  Guarded routes' requests (see
+         * RouteConfig::setGuard( )) with a body still to read are checked on the headers alone,
+         * on the executor; the body is only read (and 100-continue only sent) once they pass.
+         * A request turned away with its body unread ends the session after its response.
+         *
+         * Streaming routes' bodies (see RouteConfig::stream( )) are read a piece at a time, once
+         * the responses before them are written; each piece is handed to the route's stream on
+         * the executor and what it produces is written as a chunk before the next is read.
+         */
+
        protected:
         /**
          * @brief Set values on initial connection
@@ -100,6 +167,18 @@ namespace token {
           }
         }
 
+        /**
+         * @brief Hand the session over to HTTP/2, e.g. on ALPN or the h2c connection preface
+         */
+        void upgrade( ) {
+          do_connect( );
+
+          LOG( logger, debug, "Session from {} is using HTTP/2", remote );
+
+          http2 = std::make_shared< http2_type >( subclass( ) );
+          http2->start( );
+        }
+
         /**
          * @brief Set the http status and description
          * @param resp response message
@@ -110,6 +189,15 @@ namespace token {
           resp->reason( http::detail::status_to_string( static_cast< unsigned >( status ) ) );
         }
 
+        /**
+         * @brief Answer that the service is too busy, and when to try again
+         * @param resp response message
+         */
+        void unavailable( response_type *resp ) {
+          error_set( resp, http::status::service_unavailable );
+          resp->set( http::field::retry_after, "1" );
+        }
+
         /**
          * @brief Stringify the endpoint address
          * @brief ep tcp endpoint
@@ -140,24 +228,360 @@ namespace token {
         }
 
         /**
-         * @brief Initiate an asynchronous read that invokes 'on_read' on successful HTTP message
-         * parse
+         * @brief Initiate an asynchronous read of a request's headers that invokes 'on_header',
+         *        unless a read is already pending, the pipeline is full or the session is closing
          */
         virtual void perform_read( ) {
-          auto req = std::make_shared< request_type >( );
-          http::async_read(
+          if ( reading || closing || ( sequence - written >= route_config->getPipeline( ) ) ) {
+            return;
+          }
+
+          reading      = true;
+          auto x       = std::make_shared< exchange_type >( );
+          x->request   = std::shared_ptr< request_type >( x, &x->parser.get( ) );
+          auto &parser = x->parser;
+          parser.body_limit( std::numeric_limits< std::uint64_t >::max( ) ); // See on_header( )
+          http::async_read_header(
             subclass( ).transport( ),
             buffer,
-            *req,
+            parser,
             networking::bind_executor( strand,
-                                       std::bind( &self_type::on_read, //
+                                       std::bind( &self_type::on_header, //
                                                   shared( ), // Extend this object's lifetime
-                                                  req,
+                                                  std::move( x ),
+                                                  std::placeholders::_1,
+                                                  std::placeholders::_2 ) ) );
+        }
+
+        /**
+         * @brief Read the rest of a request, once it may be; answering 100-continue first if the
+         *        client is waiting for it, and streaming it if its route streams (both after the
+         *        responses to the requests before it)
+         * @param x request exchange
+         */
+        void read_body( std::shared_ptr< exchange_type > x ) {
+          auto expect = beast::iequals( ( *x->request )[ http::field::expect ], "100-continue" );
+
+          if ( !expect && !x->open ) {
+            perform_body( std::move( x ), { } );
+          } else if ( writing || ( written != x->seq ) ) {
+            waiting = std::move( x ); // See on_write( )
+          } else if ( !expect ) {
+            stream_begin( std::move( x ) );
+          } else {
+            auto resp = std::make_shared< http::response< http::empty_body > >(
+              http::status::continue_, x->request->version( ) );
+
+            writing = true;
+            http::async_write( subclass( ).transport( ),
+                               *resp,
+                               networking::bind_executor( strand,
+                                                          std::bind( &self_type::on_continue,
+                                                                     shared( ),
+                                                                     std::move( x ),
+                                                                     resp,
+                                                                     std::placeholders::_1 ) ) );
+          }
+        }
+
+        /**
+         * @brief Interim (100-continue) response write completion notification
+         * @param x request exchange - bound reference
+         * @param ec boost error code
+         */
+        void on_continue( std::shared_ptr< exchange_type > &                       x,
+                          std::shared_ptr< http::response< http::empty_body > > &,
+                          boost::system::error_code ec ) {
+          writing = false;
+          perform_body( std::move( x ), ec );
+        }
+
+        /**
+         * @brief Initiate an asynchronous read of a request's body that invokes 'on_body'
+         * @param x request exchange
+         * @param ec error so far
+         */
+        void perform_body( std::shared_ptr< exchange_type > x, boost::system::error_code ec ) {
+          if ( ec ) {
+            on_body( x, ec, 0 );
+            return;
+          } else if ( x->open ) {
+            stream_begin( std::move( x ) );
+            return;
+          }
+
+          auto &parser = x->parser;
+          http::async_read( subclass( ).transport( ),
+                            buffer,
+                            parser,
+                            networking::bind_executor( strand,
+                                                       std::bind( &self_type::on_body, //
+                                                                  shared( ),
+                                                                  std::move( x ),
+                                                                  std::placeholders::_1,
+                                                                  std::placeholders::_2 ) ) );
+        }
+
+        /**
+         * @brief Start streaming a request, writing the response headers; its turn to write
+         * @param x request exchange
+         */
+        void stream_begin( std::shared_ptr< exchange_type > x ) {
+          identify( *x );
+          x->pool     = pool_for( x->params );
+          x->response = std::make_shared< response_type >( );
+
+          try {
+            x->stream = x->open( x->params, *x->request, *x->response );
+          } catch ( std::exception &ex ) {
+            LOG( logger,
+                 info,
+                 "Exception encountered while opening a stream for {}: {}",
+                 address_local( ),
+                 ex.what( ) );
+            error_set( x->response.get( ), http::status::internal_server_error );
+          }
+
+          if ( !x->stream ) {
+            // Answered without the body; nothing after it can be read
+            reading = false;
+            closing = true;
+            x->response->keep_alive( false );
+            x->response->prepare_payload( );
+            on_complete( x->seq, x->response );
+            return;
+          } else if ( !x->pool->admit( x->options.priority ) ) {
+            LOG( logger, warn, "Shedding request from {}, the workers are overloaded", remote );
+            reading = false;
+            closing = true;
+            shed( x->seq, false );
+            return;
+          }
+
+          x->response->keep_alive( x->request->keep_alive( ) );
+          x->response->chunked( true );
+          x->writer.reset( new writer_type( *x->response ) );
+
+          auto &writer = *x->writer;
+          writing      = true;
+          http::async_write_header(
+            subclass( ).transport( ),
+            writer,
+            networking::bind_executor( strand,
+                                       std::bind( &self_type::on_stream_write, //
+                                                  shared( ),
+                                                  std::move( x ),
+                                                  std::placeholders::_1,
+                                                  std::placeholders::_2 ) ) );
+        }
+
+        /**
+         * @brief Read the next piece of a streamed request's body
+         * @param x request exchange
+         */
+        void stream_read( std::shared_ptr< exchange_type > x ) {
+          auto &parser = x->parser;
+          http::async_read_some(
+            subclass( ).transport( ),
+            buffer,
+            parser,
+            networking::bind_executor( strand,
+                                       std::bind( &self_type::on_stream_read, //
+                                                  shared( ),
+                                                  std::move( x ),
                                                   std::placeholders::_1,
                                                   std::placeholders::_2 ) ) );
         }
 
+        /**
+         * @brief Hand the piece of a streamed request's body just read to its stream
+         * @param x request exchange - bound reference
+         * @param ec boost error code
+         */
+        void on_stream_read( std::shared_ptr< exchange_type > &x,
+                             boost::system::error_code         ec,
+                             std::size_t ) {
+          if ( ec ) {
+            stream_end( x, ec );
+            return;
+          }
+
+          auto &body = x->request->body( );
+          auto  done = x->parser.is_done( );
+
+          if ( body.empty( ) && !done ) {
+            stream_read( std::move( x ) ); // Framing only (chunk headers)
+            return;
+          }
+
+          auto piece = std::make_shared< std::string >( std::move( body ) );
+          body.clear( );
+
+          x->pool->add( x->options.priority,
+                        x->flow,
+                        std::bind( &self_type::stream_feed, //
+                                   shared( ),
+                                   x,
+                                   std::move( piece ),
+                                   done ) );
+        }
+
+        /**
+         * @brief Feed a piece of a streamed request's body to its stream; on a worker
+         * @param x request exchange
+         * @param piece request body piece
+         * @param done the request body is complete
+         */
+        void stream_feed( std::shared_ptr< exchange_type > &x,
+                          std::shared_ptr< std::string > &  piece,
+                          bool                              done ) {
+          Connection::Scope scope( connection );
+          bool              ok = false;
+
+          x->out.clear( );
+
+          try {
+            ok = x->stream->write( *piece, x->out ) && ( !done || x->stream->finish( x->out ) );
+          } catch ( std::exception &ex ) {
+            LOG( logger,
+                 info,
+                 "Exception encountered while streaming request from {}: {}",
+                 address_local( ),
+                 ex.what( ) );
+          }
+
+          x->last   = done || !ok;
+          x->failed = !ok;
+
+          strand.dispatch( std::bind( &self_type::on_stream_fed, shared( ), x ) );
+        }
+
+        /**
+         * @brief Write what a stream produced from a piece of its request body, as a chunk
+         * @param x request exchange - bound reference
+         */
+        void on_stream_fed( std::shared_ptr< exchange_type > &x ) {
+          if ( x->out.empty( ) ) {
+            on_stream_write( x, { }, 0 );
+            return;
+          }
+
+          auto chunk = http::make_chunk( networking::buffer( x->out ) );
+          networking::async_write(
+            subclass( ).transport( ),
+            chunk,
+            networking::bind_executor( strand,
+                                       std::bind( &self_type::on_stream_write, //
+                                                  shared( ),
+                                                  std::move( x ),
+                                                  std::placeholders::_1,
+                                                  std::placeholders::_2 ) ) );
+        }
+
+        /**
+         * @brief Streamed response write completion notification; reads the next piece of the
+         *        request body, or ends the response
+         * @param x request exchange - bound reference
+         * @param ec boost error code
+         */
+        void on_stream_write( std::shared_ptr< exchange_type > &x,
+                              boost::system::error_code         ec,
+                              std::size_t ) {
+          if ( ec || x->ended ) {
+            stream_end( x, ec );
+          } else if ( x->last ) {
+            x->ended = true;
+            networking::async_write(
+              subclass( ).transport( ),
+              http::make_chunk_last( ),
+              networking::bind_executor( strand,
+                                         std::bind( &self_type::on_stream_write, //
+                                                    shared( ),
+                                                    std::move( x ),
+                                                    std::placeholders::_1,
+                                                    std::placeholders::_2 ) ) );
+          } else {
+            stream_read( std::move( x ) );
+          }
+        }
+
+        /**
+         * @brief Finish streaming a request, then carry on with the next
+         * @param x request exchange - bound reference
+         * @param ec boost error code
+         */
+        void stream_end( std::shared_ptr< exchange_type > &x, boost::system::error_code ec ) {
+          if ( ec ) {
+            LOG( logger, err, "Error encountered while streaming {}: {}", remote, ec.message( ) );
+          }
+
+          if ( ec || x->failed || !x->parser.is_done( ) ) {
+            closing = true; // The rest of the request, if any, can't be found
+          }
+
+          x->stream.reset( );
+          reading = false;
+          writing = false;
+          ++written;
+
+          flush( );
+          perform_read( );
+        }
+
+        /**
+         * @brief Write the next response, if it is ready and no write is pending
+         */
+        void flush( ) {
+          if ( writing || responses.empty( ) || !responses.front( ) ) {
+            if ( closing && !writing && ( written == sequence ) ) {
+              boost::system::error_code ec;
+              sock.shutdown( tcp_type::socket::shutdown_send, ec );
+            }
+
+            return;
+          }
+
+          auto resp = std::move( responses.front( ) );
+
+          responses.pop_front( );
+          writing = true;
+          perform_write( std::move( resp ) );
+        }
+
        public:
+        /**
+         * @brief Accept a request's response, to be written in request order; on the strand
+         * @param seq request number
+         * @param resp http response
+         */
+        void on_complete( size_t seq, std::shared_ptr< response_type > &resp ) {
+          if ( http2 ) {
+            http2->respond( seq, std::move( resp ) );
+            return;
+          }
+
+          auto slot = seq - written - ( writing ? 1 : 0 );
+
+          if ( responses.size( ) <= slot ) {
+            responses.resize( slot + 1 );
+          }
+
+          responses[ slot ] = std::move( resp );
+          flush( );
+        }
+
+        /**
+         * @brief Hand a request's response to the strand, to be written in request order
+         * @param seq request number
+         * @param resp http response
+         */
+        void complete( size_t seq, std::shared_ptr< response_type > resp ) {
+          strand.dispatch( std::bind( &self_type::on_complete, //
+                                      shared( ),
+                                      seq,
+                                      std::move( resp ) ) );
+        }
+
         /**
          * @brief Beast write completion notification
          * @param response message sent in response - bound reference
@@ -171,76 +595,352 @@ namespace token {
                        bool                              eof ) {
           boost::ignore_unused( bytes );
 
+          writing = false;
+          ++written;
+
+          if ( response.use_count( ) == 1 && response->body( ).capacity( ) <= spare_limit ) {
+            spare = std::move( response ); // Its body's storage, for the next response
+          }
+
           if ( ( ec == beast::http::error::end_of_stream ) || ( eof ) ) {
+            closing = true;
             sock.shutdown( tcp_type::socket::shutdown_send, ec );
-          } else if ( !ec ) {
+          } else if ( ec ) {
+            closing = true;
+          } else {
+            if ( waiting && ( written == waiting->seq ) ) {
+              read_body( std::move( waiting ) ); // Its turn for 100-continue
+            }
+
+            flush( );
             perform_read( );
           }
         }
 
         /**
-         * @brief Capture, route match and queue an incoming request for processing
-         * @param request reference to bound shared pointer - bound reference
+         * @brief Capture and route match a request's headers, then check it or read its body
+         * @param x request exchange - bound reference
+         */
+        void on_header( std::shared_ptr< exchange_type > &x,
+                        boost::system::error_code         ec,
+                        std::size_t ) {
+          if ( ec ) {
+            on_body( x, ec, 0 );
+            return;
+          }
+
+          do_connect( );
+
+          x->seq = sequence++;
+
+          if ( !x->request->keep_alive( ) ) {
+            closing = true; // The client expects nothing after this one
+          }
+
+          match( *x );
+
+          if ( !x->open ) {
+            auto          length = x->parser.content_length( );
+            std::uint64_t limit  = body_limit;
+
+            if ( length && ( *length > limit ) ) {
+              // Too large to be read whole; nothing after it can be read
+              auto resp = std::make_shared< response_type >( );
+              error_set( resp.get( ), http::status::payload_too_large );
+              resp->keep_alive( false );
+              resp->prepare_payload( );
+              reading = false;
+              closing = true;
+              on_complete( x->seq, resp );
+              return;
+            }
+
+            x->parser.body_limit( limit );
+          }
+
+          if ( x->parser.is_done( ) ) {
+            on_body( x, ec, 0 ); // Nothing more to read
+          } else if ( !guarded( x->options ) ) {
+            read_body( std::move( x ) );
+          } else if ( !check( x ) ) {
+            // Turned away without reading its body; nothing after it can be read
+            reading = false;
+            closing = true;
+          }
+        }
+
+        /**
+         * @brief Dispatch a request once it has been read in full
+         * @param x request exchange - bound reference
          */
-        void on_read( std::shared_ptr< request_type > &request,
-                      boost::system::error_code        ec,
+        void on_body( std::shared_ptr< exchange_type > &x,
+                      boost::system::error_code         ec,
                       std::size_t ) {
+          reading = false;
+
           if ( ec ) {
-            if ( ec == http::error::end_of_stream ) {
-              sock.shutdown( tcp_type::socket::shutdown_send, ec );
-            } else {
+            if ( ec != http::error::end_of_stream ) {
               LOG(
                 logger, err, "Error encountered while reading from {}: {}", remote, ec.message( ) );
             }
 
+            // Finish writing the responses already in hand, then close
+            closing = true;
+            flush( );
             return;
           }
 
-          do_connect( );
+          dispatch( std::move( x ) );
+          perform_read( ); // Read ahead, if the pipeline has room
+        }
 
-          const std::string method   = http::to_string( request->method( ) ).to_string( );
-          std::string       resource = request->target( ).to_string( );
-          param_map_type    params;
+        /**
+         * @brief Accept the result of checking a request's headers; on the strand
+         * @param x request exchange - bound reference
+         * @param resp response to turn it away with, null if it passed
+         */
+        void on_guard( std::shared_ptr< exchange_type > &x,
+                       std::shared_ptr< response_type > &resp ) {
+          if ( http2 ) {
+            http2->guarded( std::move( x ), std::move( resp ) );
+          } else if ( resp ) {
+            // Turned away without reading its body; nothing after it can be read
+            reading = false;
+            closing = true;
+            on_complete( x->seq, resp );
+          } else {
+            read_body( std::move( x ) );
+          }
+        }
 
-          resource.erase( std::find( resource.begin( ), resource.end( ), '?' ), resource.end( ) );
+        /**
+         * @brief Identify if a route's requests are to be checked on their headers
+         * @param options route options
+         * @return true if checked
+         */
+        bool guarded( const RouteOptions &options ) const {
+          return ( options.guard == Guard::headers ) && ( route_config->getGuard( ) );
+        }
 
-          handler_type handler = route_config->getRoute( request->method( ), resource, params );
+        /**
+         * @brief Route match a request
+         * @param x request exchange; its handler, path parameters, options and stream are set,
+         *          the handler answers not found if no route matched
+         */
+        void match( exchange_type &x ) {
+          auto &request = *x.request;
+          auto  target  = request.target( );
+          auto  path    = target.substr( 0, target.find( '?' ) );
+          auto  route   = route_config->findRoute( request.method( ), path, x.params );
+
+          if ( route ) {
+            x.handler = std::get< 1 >( *route );
+            x.options = std::get< 2 >( *route );
+            x.open    = std::get< 3 >( *route );
+          } else {
+            x.handler = route_config->getDefault( );
+          }
 
-          if ( !handler ) {
+          if ( !x.handler ) {
             LOG( logger,
                  info,
                  "Unknown route for request from {} for {} '{}'",
                  address_remote( ),
-                 method,
-                 resource );
-            handler = [ & ]( param_map_type &, request_type &, response_type &resp ) {
+                 http::to_string( request.method( ) ).to_string( ),
+                 path.to_string( ) );
+            x.handler = [ & ]( param_map_type &, request_type &, response_type &resp ) {
               error_set( &resp, http::status::not_found );
               return true;
             };
+            x.options = Dispatch::immediate;
           } else {
-            LOG( logger, info, "Request from {} for {} '{}'", address_remote( ), method, resource );
+            LOG( logger,
+                 info,
+                 "Request from {} for {} '{}'",
+                 address_remote( ),
+                 http::to_string( request.method( ) ).to_string( ),
+                 path.to_string( ) );
           }
+        }
 
-          executor->add( std::bind( &self_type::perform, //
-                                    shared( ),
-                                    std::move( request ),
-                                    handler,
-                                    std::move( params ) ) );
+        /**
+         * @brief Get the executor to handle a request on
+         * @param params path parameters
+         * @return executor
+         */
+        executor_type *pool_for( const param_map_type &params ) const {
+          auto pool = route_config->getExecutor( params );
+          return pool ? pool : executor.get( );
         }
 
-        void dostuff( std::shared_ptr< request_type > req ) {}
+        /**
+         * @brief Identify who a request is made for (see RouteConfig::setRequester( )), to queue
+         *        it on their behalf; on the strand
+         * @param x request exchange; its flow is set, unless already known
+         */
+        void identify( exchange_type &x ) {
+          if ( !x.flow ) {
+            Connection::Scope scope( connection );
+            x.flow = route_config->getFlow( *x.request );
+          }
+        }
 
         /**
-         * @brief Process an http request action
-         * @param req http request
-         * @param handler route handler
-         * @param params query (path) parameters
+         * @brief Queue the check of a request's headers, ahead of reading its body
+         * @param x request exchange, route matched
+         * @return false if shed (and answered) instead
          */
-        void perform( std::shared_ptr< request_type > req,
-                      handler_type                    handler,
-                      param_map_type                  params ) {
+        bool check( const std::shared_ptr< exchange_type > &x ) {
+          auto pool = pool_for( x->params );
+
+          if ( !pool->admit( x->options.priority ) ) {
+            LOG( logger, warn, "Shedding request from {}, the workers are overloaded", remote );
+            shed( x->seq, false ); // Its body goes unread, see on_header( )
+            return false;
+          }
+
+          identify( *x );
+          pool->add( x->options.priority,
+                     x->flow,
+                     std::bind( &self_type::guard, //
+                                shared( ),
+                                x,
+                                pool,
+                                executor_type::clock_type::now( ) ) );
+          return true;
+        }
+
+        /**
+         * @brief Check a request's headers; on a worker
+         * @param x request exchange
+         * @param pool executor the check was queued on
+         * @param queued when the check was queued
+         */
+        void guard( std::shared_ptr< exchange_type > &x,
+                    executor_type *                   pool,
+                    executor_type::time_type          queued ) {
+          auto              resp = std::make_shared< response_type >( );
+          Connection::Scope scope( connection );
+
+          try {
+            if ( pool->expired( queued ) ) {
+              LOG( logger, warn, "Request from {} expired in the work queue", remote );
+              unavailable( resp.get( ) );
+            } else if ( route_config->getGuard( )( x->params, *x->request, *resp ) ) {
+              resp.reset( );
+            }
+          } catch ( std::exception &ex ) {
+            LOG( logger,
+                 info,
+                 "Exception encountered while checking request from {}: {}",
+                 address_local( ),
+                 ex.what( ) );
+            error_set( resp.get( ), http::status::internal_server_error );
+          }
+
+          if ( resp ) {
+            resp->keep_alive( false ); // Its body goes unread, see on_guard( )
+            resp->prepare_payload( );
+          }
+
+          x->checked = true;
+          strand.dispatch( std::bind( &self_type::on_guard, shared( ), x, std::move( resp ) ) );
+        }
+
+        /**
+         * @brief Handle a complete request here, or queue it for the workers
+         * @param x request exchange, route matched
+         */
+        void dispatch( std::shared_ptr< exchange_type > x ) {
+          using perform_type =
+            decltype( std::bind( &self_type::perform,
+                                 std::declval< std::shared_ptr< sub_type > >( ),
+                                 std::declval< std::shared_ptr< exchange_type > >( ) ) );
+          static_assert( token::async::Task::fits< perform_type >::value,
+                         "A queued request must be stored inline by the executor" );
+
+          auto pool     = pool_for( x->params );
+          auto priority = x->options.priority;
+
+          if ( guarded( x->options ) && !x->checked ) {
+            auto handler = std::move( x->handler );
+
+            // Read in full already; check it on the way to its handler
+            x->handler = [ this, handler ]( param_map_type &params,
+                                            request_type &  request,
+                                            response_type & response ) {
+              return !route_config->getGuard( )( params, request, response ) ||
+                     handler( params, request, response );
+            };
+          }
+
+          x->pool     = pool;
+          x->queued   = executor_type::clock_type::now( );
+          x->response = recycled( );
+
+          if ( x->options.dispatch == Dispatch::immediate ) {
+            // Non-blocking; handle it here rather than pay for the trip through the queues
+            perform( x );
+          } else if ( !pool->admit( priority ) ) {
+            LOG( logger, warn, "Shedding request from {}, the workers are overloaded", remote );
+            shed( x->seq, x->request->keep_alive( ) );
+          } else {
+            identify( *x ); // Again if unknown; a passed check has validated its credential
+
+            auto flow = x->flow;
+            pool->add( priority, //
+                       flow,
+                       std::bind( &self_type::perform, shared( ), std::move( x ) ) );
+          }
+        }
+
+        /**
+         * @brief Make a response, its body reusing the last written response's storage; on the
+         *        strand
+         * @return empty response
+         */
+        std::shared_ptr< response_type > recycled( ) {
           auto resp = std::make_shared< response_type >( );
 
+          if ( spare ) {
+            resp->body( ) = std::move( spare->body( ) );
+            resp->body( ).clear( );
+            spare.reset( );
+          }
+
+          return resp;
+        }
+
+        /**
+         * @brief Turn a request away, from the IO thread, without queuing it
+         * @param seq request number
+         * @param keep_alive false if the session closes after answering, e.g. as the request's
+         *                   body is left unread
+         */
+        void shed( size_t seq, bool keep_alive ) {
+          auto resp = std::make_shared< response_type >( );
+
+          unavailable( resp.get( ) );
+          resp->keep_alive( keep_alive );
+          resp->prepare_payload( );
+
+          complete( seq, std::move( resp ) );
+        }
+
+        /**
+         * @brief Process an http request action; on a worker, or on the IO thread for
+         *        immediate routes
+         * @param x request exchange, as dispatched: its handler, path parameters, executor (the
+         *          one it was queued on, or would have been), when it was queued, and the
+         *          response to fill in (see recycled( ))
+         */
+        void perform( std::shared_ptr< exchange_type > &x ) {
+          auto &            req     = x->request;
+          auto &            resp    = x->response;
+          auto &            handler = x->handler;
+          auto &            params  = x->params;
+          Connection::Scope scope( connection );
+
           try {
             // Track our progress...
             LOG( logger,
@@ -253,8 +953,11 @@ namespace token {
             // Respond in kind to the client's keep alive request
             resp->keep_alive( req->keep_alive( ) );
 
-            // Handle the request
-            if ( !handler( params, *req, *resp ) ) {
+            // Handle the request, unless it waited so long the client has likely given up
+            if ( x->pool->expired( x->queued ) ) {
+              LOG( logger, warn, "Request from {} expired in the work queue", remote );
+              unavailable( resp.get( ) );
+            } else if ( !handler( params, *req, *resp ) ) {
               LOG( logger, info, "Failed to process a request from {}", address_local( ) );
               error_set( resp.get( ), http::status::internal_server_error );
             }
@@ -280,7 +983,7 @@ namespace token {
           // Stage for write
           resp->prepare_payload( );
 
-          perform_write( std::move( resp ) );
+          complete( x->seq, std::move( resp ) );
         }
 
        protected:
@@ -292,6 +995,16 @@ namespace token {
         std::shared_ptr< spdlog::logger > logger;
         std::string                       local;
         std::string                       remote;
+        Connection                        connection;
+        std::shared_ptr< http2_type >     http2;            /**< Set once using HTTP/2 */
+        pending_type                      responses;        /**< Awaiting their turn */
+        std::shared_ptr< response_type >  spare;            /**< Written, for its body's storage */
+        std::shared_ptr< exchange_type >  waiting;          /**< Awaiting 100-continue */
+        size_t                            sequence = 0;     /**< Requests read */
+        size_t                            written  = 0;     /**< Responses written */
+        bool                              reading  = false; /**< Read pending */
+        bool                              writing  = false; /**< Write pending */
+        bool                              closing  = false; /**< No more requests to read */
       };
     } // namespace http
   }   // namespace api
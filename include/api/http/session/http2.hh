@@ -0,0 +1,649 @@
+#ifndef __SESSION_HTTP2_HH_
+#define __SESSION_HTTP2_HH_
+
+#include "api/http/session/basic.hh"
+#include <boost/asio/ssl/context.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/logic/tribool.hpp>
+#include <cctype>
+#include <cstring>
+#include <nghttp2/nghttp2.h>
+#include <unordered_map>
+
+namespace token {
+  namespace api {
+    namespace http {
+
+      /**
+       * @brief Offer HTTP/2 (ALPN "h2") ahead of HTTP/1.1 on sessions accepted with a context
+       * @param ctx ssl context
+       */
+      inline void advertise_http2( networking::ssl::context &ctx ) {
+        SSL_CTX_set_alpn_select_cb(
+          ctx.native_handle( ),
+          []( SSL *,
+              const unsigned char **out,
+              unsigned char *       outlen,
+              const unsigned char * in,
+              unsigned int          inlen,
+              void * ) -> int {
+            auto selected = nghttp2_select_next_protocol(
+              const_cast< unsigned char ** >( out ), outlen, in, inlen );
+            return ( selected < 0 ) ? SSL_TLSEXT_ERR_NOACK : SSL_TLSEXT_ERR_OK;
+          },
+          nullptr );
+      }
+
+      /**
+       * @brief HTTP/2 protocol handler of a session
+       *
+       * Frames are read and written over the session's transport, on its strand, and decoded
+       * by nghttp2; each request stream is routed and handled exactly as an HTTP/1.1 request
+       * is (see Session::dispatch( )), numbered by its stream id, so streams are handled
+       * concurrently and answered as they complete rather than in order.  Guarded routes'
+       * requests are checked once their headers are in; a request turned away has the rest of
+       * its body dropped as it arrives, and once its response is sent the stream is reset
+       * (NO_ERROR) so the client stops sending it (RFC 7540, section 8.1).
+       *
+       * The session owns its handler; pending operations hold on to the session.
+       */
+      template < class session_type, typename traits = DefaultTypeTraits >
+      class Http2 {
+        using self_type     = Http2< session_type, traits >;
+        using request_type  = typename traits::request_type;
+        using response_type = typename traits::response_type;
+        using exchange_type = typename session_type::exchange_type;
+        using callback_type = std::unique_ptr< nghttp2_session_callbacks,
+                                               decltype( &nghttp2_session_callbacks_del ) >;
+
+        struct stream_type {
+          std::shared_ptr< exchange_type > exchange;        /**< Being received */
+          std::shared_ptr< response_type > response;        /**< Being sent */
+          size_t                           offset  = 0;     /**< Response body sent */
+          bool                             pending = false; /**< Headers being checked */
+          bool                             ended   = false; /**< Request received in full */
+          bool                             refused = false; /**< Reset once answered */
+        };
+
+        /** Largest request body, as with HTTP/1.1 (beast's default) */
+        static constexpr size_t body_limit = 1024 * 1024;
+        /** Most to read at once */
+        static constexpr size_t read_size = 16 * 1024;
+        /** Most frames to gather into one write */
+        static constexpr size_t write_size = 64 * 1024;
+
+        session_type &                             session;
+        nghttp2_session *                          h2 = nullptr;
+        std::unordered_map< int32_t, stream_type > streams;
+        std::string                                out;               /**< Being written */
+        bool                                       reading   = false; /**< Read pending */
+        bool                                       writing   = false; /**< Write pending */
+        bool                                       receiving = false; /**< In nghttp2 callbacks */
+        bool                                       closing   = false; /**< Nothing more to read */
+
+       public:
+        explicit Http2( session_type &_session )
+          : session( _session ) {}
+
+        Http2( const Http2 & ) = delete;
+        Http2 &operator=( const Http2 & ) = delete;
+
+        ~Http2( ) { nghttp2_session_del( h2 ); }
+
+        /**
+         * @brief Identify if received data starts with the HTTP/2 (h2c) connection preface
+         * @param buff data received so far
+         * @return true for HTTP/2, false for not, indeterminate for not yet known
+         */
+        static boost::tribool prefaced( boost::asio::const_buffer buff ) {
+          auto count = std::min< size_t >( buff.size( ), NGHTTP2_CLIENT_MAGIC_LEN );
+
+          if ( std::memcmp( buff.data( ), NGHTTP2_CLIENT_MAGIC, count ) != 0 ) {
+            return false;
+          } else if ( count < NGHTTP2_CLIENT_MAGIC_LEN ) {
+            return boost::indeterminate;
+          } else {
+            return true;
+          }
+        }
+
+        /**
+         * @brief Identify if HTTP/2 was negotiated, by ALPN, on a TLS connection
+         * @param ssl connection
+         * @return true for HTTP/2
+         */
+        static bool negotiated( SSL *ssl ) {
+          const unsigned char *protocol = nullptr;
+          unsigned int         length   = 0;
+
+          SSL_get0_alpn_selected( ssl, &protocol, &length );
+
+          return ( length == NGHTTP2_PROTO_VERSION_ID_LEN ) &&
+                 ( std::memcmp( protocol, NGHTTP2_PROTO_VERSION_ID, length ) == 0 );
+        }
+
+        /**
+         * @brief Start the connection; on the strand, with whatever the session read ahead
+         */
+        void start( ) {
+          nghttp2_settings_entry settings[] = {
+            { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS,
+              static_cast< uint32_t >( session.route_config->getStreams( ) ) },
+          };
+
+          nghttp2_session_server_new( &h2, callbacks( ), this );
+          nghttp2_submit_settings( h2, NGHTTP2_FLAG_NONE, settings, 1 );
+
+          if ( receive( ) ) {
+            flush( );
+            perform_read( );
+          }
+        }
+
+        /**
+         * @brief Send a stream's response; on the strand
+         * @param id stream id
+         * @param resp http response
+         */
+        void respond( size_t id, std::shared_ptr< response_type > resp ) {
+          auto found = streams.find( static_cast< int32_t >( id ) );
+
+          if ( found == streams.end( ) ) {
+            return; // The client gave up on it
+          }
+
+          auto &stream    = found->second;
+          stream.response = std::move( resp );
+
+          auto                      status = std::to_string( stream.response->result_int( ) );
+          std::deque< std::string > names;
+          std::vector< nghttp2_nv > headers{ header( ":status", status ) };
+
+          for ( auto &field : *stream.response ) {
+            switch ( field.name( ) ) {
+              case http::field::connection:
+              case http::field::keep_alive:
+              case http::field::proxy_connection:
+              case http::field::transfer_encoding:
+              case http::field::upgrade:
+                continue; // Connection specific, not allowed in HTTP/2
+              default:
+                break;
+            }
+
+            names.emplace_back( field.name_string( ).to_string( ) );
+            std::transform( names.back( ).begin( ),
+                            names.back( ).end( ),
+                            names.back( ).begin( ),
+                            []( unsigned char c ) { return std::tolower( c ); } );
+            headers.push_back( header( names.back( ), field.value( ) ) );
+          }
+
+          nghttp2_data_provider body;
+          body.source.ptr    = &stream;
+          body.read_callback = &self_type::on_body;
+
+          auto rc = nghttp2_submit_response( h2,
+                                             found->first,
+                                             headers.data( ),
+                                             headers.size( ),
+                                             stream.response->body( ).empty( ) ? nullptr : &body );
+          if ( rc != 0 ) {
+            LOG( session.logger,
+                 err,
+                 "Failed to respond to {} on stream {}: {}",
+                 session.remote,
+                 id,
+                 nghttp2_strerror( rc ) );
+          }
+
+          if ( !receiving ) {
+            flush( );
+          }
+        }
+
+        /**
+         * @brief Accept the result of checking a stream's request headers; on the strand
+         * @param x request exchange
+         * @param resp response to turn it away with, null if it passed
+         */
+        void guarded( std::shared_ptr< exchange_type > x, std::shared_ptr< response_type > resp ) {
+          auto found = streams.find( static_cast< int32_t >( x->seq ) );
+
+          if ( ( found == streams.end( ) ) || ( found->second.exchange != x ) ) {
+            return; // The client gave up on it
+          }
+
+          auto &stream   = found->second;
+          stream.pending = false;
+
+          if ( resp ) {
+            stream.exchange.reset( );
+            stream.refused = !stream.ended;
+            respond( x->seq, std::move( resp ) );
+          } else if ( stream.ended ) {
+            session.dispatch( std::move( stream.exchange ) );
+          } else {
+            proceed( found->first, *x->request );
+            flush( );
+          }
+        }
+
+       protected:
+        /**
+         * @brief Get the nghttp2 callbacks, shared by all connections
+         * @return callbacks
+         */
+        static const nghttp2_session_callbacks *callbacks( ) {
+          static const callback_type instance = []( ) {
+            nghttp2_session_callbacks *result = nullptr;
+
+            nghttp2_session_callbacks_new( &result );
+            nghttp2_session_callbacks_set_on_begin_headers_callback( result, &on_begin_headers );
+            nghttp2_session_callbacks_set_on_header_callback( result, &on_header );
+            nghttp2_session_callbacks_set_on_data_chunk_recv_callback( result, &on_data );
+            nghttp2_session_callbacks_set_on_frame_recv_callback( result, &on_frame );
+            nghttp2_session_callbacks_set_on_stream_close_callback( result, &on_close );
+            nghttp2_session_callbacks_set_on_frame_send_callback( result, &on_sent );
+
+            return callback_type( result, &nghttp2_session_callbacks_del );
+          }( );
+
+          return instance.get( );
+        }
+
+        /**
+         * @brief Make a header to send
+         * @param name lowercase header name
+         * @param value header value
+         * @return nghttp2 header, referring to name and value
+         */
+        static nghttp2_nv header( boost::string_view name, boost::string_view value ) {
+          return { reinterpret_cast< uint8_t * >( const_cast< char * >( name.data( ) ) ),
+                   reinterpret_cast< uint8_t * >( const_cast< char * >( value.data( ) ) ),
+                   name.size( ),
+                   value.size( ),
+                   NGHTTP2_NV_FLAG_NONE };
+        }
+
+        /**
+         * @brief Initiate an asynchronous read, unless one is pending or the client is done
+         */
+        void perform_read( ) {
+          if ( reading || closing ) {
+            return;
+          }
+
+          reading = true;
+          session.transport( ).async_read_some(
+            session.buffer.prepare( read_size ),
+            networking::bind_executor( session.strand,
+                                       std::bind( &self_type::on_read,
+                                                  this,
+                                                  session.shared( ), // Extend session lifetime
+                                                  std::placeholders::_1,
+                                                  std::placeholders::_2 ) ) );
+        }
+
+        /**
+         * @brief Read completion notification
+         * @param ec boost error code
+         * @param received bytes received
+         */
+        void on_read( std::shared_ptr< session_type > &,
+                      boost::system::error_code ec,
+                      std::size_t               received ) {
+          reading = false;
+
+          if ( ec ) {
+            if ( ( ec != networking::error::eof ) &&
+                 ( ec != networking::ssl::error::stream_truncated ) ) {
+              LOG( session.logger,
+                   err,
+                   "Error encountered while reading from {}: {}",
+                   session.remote,
+                   ec.message( ) );
+            }
+
+            // Finish the streams already in hand, then close
+            closing = true;
+            flush( );
+            return;
+          }
+
+          session.buffer.commit( received );
+
+          if ( receive( ) ) {
+            flush( );
+            perform_read( );
+          }
+        }
+
+        /**
+         * @brief Process the data received, invoking the callbacks for each frame
+         * @return false on protocol error; the connection is closed
+         */
+        bool receive( ) {
+          auto data = session.buffer.data( );
+
+          receiving = true;
+          auto used = nghttp2_session_mem_recv(
+            h2, static_cast< const uint8_t * >( data.data( ) ), data.size( ) );
+          receiving = false;
+
+          if ( used < 0 ) {
+            LOG( session.logger,
+                 err,
+                 "HTTP/2 protocol error from {}: {}",
+                 session.remote,
+                 nghttp2_strerror( static_cast< int >( used ) ) );
+            shutdown( );
+            return false;
+          }
+
+          session.buffer.consume( static_cast< size_t >( used ) );
+          return true;
+        }
+
+        /**
+         * @brief Write the frames waiting to be sent, unless a write is pending; closes the
+         *        connection once neither side has anything more to say
+         */
+        void flush( ) {
+          if ( writing ) {
+            return;
+          }
+
+          const uint8_t *data   = nullptr;
+          ssize_t        length = 0;
+
+          out.clear( );
+          while ( ( out.size( ) < write_size ) &&
+                  ( ( length = nghttp2_session_mem_send( h2, &data ) ) > 0 ) ) {
+            out.append( reinterpret_cast< const char * >( data ), length );
+          }
+
+          if ( length < 0 ) {
+            LOG( session.logger,
+                 err,
+                 "HTTP/2 error writing to {}: {}",
+                 session.remote,
+                 nghttp2_strerror( static_cast< int >( length ) ) );
+            shutdown( );
+            return;
+          }
+
+          if ( out.empty( ) ) {
+            if ( ( closing && streams.empty( ) ) ||
+                 ( !nghttp2_session_want_read( h2 ) && !nghttp2_session_want_write( h2 ) ) ) {
+              shutdown( );
+            }
+
+            return;
+          }
+
+          writing = true;
+          networking::async_write(
+            session.transport( ),
+            networking::buffer( out ),
+            networking::bind_executor( session.strand,
+                                       std::bind( &self_type::on_write,
+                                                  this,
+                                                  session.shared( ), // Extend session lifetime
+                                                  std::placeholders::_1,
+                                                  std::placeholders::_2 ) ) );
+        }
+
+        /**
+         * @brief Write completion notification
+         * @param ec boost error code
+         */
+        void on_write( std::shared_ptr< session_type > &,
+                       boost::system::error_code ec,
+                       std::size_t ) {
+          writing = false;
+
+          if ( ec ) {
+            LOG( session.logger,
+                 err,
+                 "Error encountered while writing to {}: {}",
+                 session.remote,
+                 ec.message( ) );
+            closing = true;
+            return;
+          }
+
+          flush( );
+        }
+
+        /**
+         * @brief Stop reading and writing
+         */
+        void shutdown( ) {
+          boost::system::error_code ec;
+
+          closing = true;
+          session.sock.shutdown( tcp_type::socket::shutdown_both, ec );
+        }
+
+        /**
+         * @brief Answer a stream without handling it, e.g. when its request is too large
+         * @param id stream id
+         * @param status http status
+         */
+        void refuse( int32_t id, http::status status ) {
+          auto resp  = std::make_shared< response_type >( );
+          auto found = streams.find( id );
+
+          if ( found != streams.end( ) ) {
+            found->second.refused = !found->second.ended;
+          }
+
+          session.error_set( resp.get( ), status );
+          resp->prepare_payload( );
+
+          respond( id, std::move( resp ) );
+        }
+
+        /**
+         * @brief Let the client send a request's body, if it's waiting to be told it may
+         * @param id stream id
+         * @param req http request headers
+         */
+        void proceed( int32_t id, const request_type &req ) {
+          if ( beast::iequals( req[ http::field::expect ], "100-continue" ) ) {
+            auto status = header( ":status", "100" );
+            nghttp2_submit_headers( h2, NGHTTP2_FLAG_NONE, id, nullptr, &status, 1, nullptr );
+          }
+        }
+
+        /**
+         * @brief Route match a stream's request once its headers are in, then check it,
+         *        dispatch it, or wait for its body
+         * @param id stream id
+         * @param ended request received in full
+         */
+        void headers( int32_t id, bool ended ) {
+          auto found = streams.find( id );
+
+          if ( ( found == streams.end( ) ) || ( !found->second.exchange ) ) {
+            return;
+          }
+
+          auto &stream = found->second;
+          auto &x      = stream.exchange;
+
+          session.match( *x );
+          stream.ended = ended;
+
+          if ( ended ) {
+            session.dispatch( std::move( x ) );
+          } else if ( !session.guarded( x->options ) ) {
+            proceed( id, *x->request );
+          } else if ( !( stream.pending = session.check( x ) ) ) {
+            x.reset( ); // Shed, and answered
+            stream.refused = true;
+          }
+        }
+
+        /**
+         * @brief Dispatch a stream's request once it's been received in full, if it's passed
+         *        its check
+         * @param id stream id
+         */
+        void ended( int32_t id ) {
+          auto found = streams.find( id );
+
+          if ( found == streams.end( ) ) {
+            return;
+          }
+
+          auto &stream = found->second;
+          stream.ended = true;
+
+          if ( ( stream.exchange ) && ( !stream.pending ) ) {
+            session.dispatch( std::move( stream.exchange ) );
+          }
+        }
+
+        static self_type *self( void *user ) { return static_cast< self_type * >( user ); }
+
+        static int on_begin_headers( nghttp2_session *, const nghttp2_frame *frame, void *user ) {
+          if ( ( frame->hd.type == NGHTTP2_HEADERS ) &&
+               ( frame->headers.cat == NGHTTP2_HCAT_REQUEST ) ) {
+            auto &stream = self( user )->streams[ frame->hd.stream_id ];
+            auto  x      = std::make_shared< exchange_type >( );
+
+            x->seq     = frame->hd.stream_id;
+            x->request = std::shared_ptr< request_type >( x, &x->parser.get( ) );
+            x->request->version( 20 );
+
+            stream.exchange = std::move( x );
+          }
+
+          return 0;
+        }
+
+        static int on_header( nghttp2_session *,
+                              const nghttp2_frame *frame,
+                              const uint8_t *      name,
+                              size_t               namelen,
+                              const uint8_t *      value,
+                              size_t               valuelen,
+                              uint8_t,
+                              void *user ) {
+          auto &streams = self( user )->streams;
+          auto  found   = streams.find( frame->hd.stream_id );
+
+          if ( ( frame->headers.cat != NGHTTP2_HCAT_REQUEST ) || ( found == streams.end( ) ) ||
+               ( !found->second.exchange ) ) {
+            return 0; // Trailers, or a refused request
+          }
+
+          auto &             req = *found->second.exchange->request;
+          boost::string_view key( reinterpret_cast< const char * >( name ), namelen );
+          boost::string_view val( reinterpret_cast< const char * >( value ), valuelen );
+
+          if ( key == ":method" ) {
+            req.method_string( val );
+          } else if ( key == ":path" ) {
+            req.target( val );
+          } else if ( key == ":authority" ) {
+            req.set( http::field::host, val );
+          } else if ( key.front( ) != ':' ) {
+            req.insert( key, val );
+          }
+
+          return 0;
+        }
+
+        static int on_data( nghttp2_session *,
+                            uint8_t,
+                            int32_t        id,
+                            const uint8_t *data,
+                            size_t         length,
+                            void *         user ) {
+          auto &streams = self( user )->streams;
+          auto  found   = streams.find( id );
+
+          if ( ( found == streams.end( ) ) || ( !found->second.exchange ) ) {
+            return 0; // Refused, or turned away by its check
+          }
+
+          auto &body = found->second.exchange->request->body( );
+
+          if ( body.size( ) + length > body_limit ) {
+            found->second.exchange.reset( );
+            found->second.pending = false;
+            self( user )->refuse( id, http::status::payload_too_large );
+          } else {
+            body.append( reinterpret_cast< const char * >( data ), length );
+          }
+
+          return 0;
+        }
+
+        static int on_frame( nghttp2_session *, const nghttp2_frame *frame, void *user ) {
+          bool ended = frame->hd.flags & NGHTTP2_FLAG_END_STREAM;
+
+          if ( ( frame->hd.type == NGHTTP2_HEADERS ) &&
+               ( frame->headers.cat == NGHTTP2_HCAT_REQUEST ) ) {
+            self( user )->headers( frame->hd.stream_id, ended );
+          } else if ( ( ( frame->hd.type == NGHTTP2_HEADERS ) ||
+                        ( frame->hd.type == NGHTTP2_DATA ) ) &&
+                      ( ended ) ) {
+            self( user )->ended( frame->hd.stream_id );
+          }
+
+          return 0;
+        }
+
+        static int on_sent( nghttp2_session *, const nghttp2_frame *frame, void *user ) {
+          auto &streams = self( user )->streams;
+
+          if ( ( ( frame->hd.type == NGHTTP2_HEADERS ) || ( frame->hd.type == NGHTTP2_DATA ) ) &&
+               ( frame->hd.flags & NGHTTP2_FLAG_END_STREAM ) ) {
+            auto found = streams.find( frame->hd.stream_id );
+
+            if ( ( found != streams.end( ) ) && ( found->second.refused ) &&
+                 ( !found->second.ended ) ) {
+              // Answered in full; the rest of its request is unwanted
+              nghttp2_submit_rst_stream(
+                self( user )->h2, NGHTTP2_FLAG_NONE, frame->hd.stream_id, NGHTTP2_NO_ERROR );
+            }
+          }
+
+          return 0;
+        }
+
+        static int on_close( nghttp2_session *, int32_t id, uint32_t, void *user ) {
+          self( user )->streams.erase( id );
+          return 0;
+        }
+
+        static ssize_t on_body( nghttp2_session *,
+                                int32_t,
+                                uint8_t *            buf,
+                                size_t               length,
+                                uint32_t *           flags,
+                                nghttp2_data_source *source,
+                                void * ) {
+          auto *stream = static_cast< stream_type * >( source->ptr );
+          auto &body   = stream->response->body( );
+          auto  count  = std::min( length, body.size( ) - stream->offset );
+
+          std::memcpy( buf, body.data( ) + stream->offset, count );
+          stream->offset += count;
+
+          if ( stream->offset == body.size( ) ) {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+          }
+
+          return static_cast< ssize_t >( count );
+        }
+      };
+    } // namespace http
+  }   // namespace api
+} // namespace token
+
+#endif // __SESSION_HTTP2_HH_
@@ -3,6 +3,7 @@
 
 #include "api/http/base.hh"
 #include "api/http/session/basic.hh"
+#include "api/http/session/http2.hh"
 
 namespace token {
   namespace api {
@@ -16,6 +17,7 @@ namespace token {
         using self_type   = PlainSession< Traits >;
         using base_type   = Session< self_type, Traits >;
         using config_type = RouteConfig< Traits >;
+        using http2_type  = Http2< self_type, Traits >;
 
        public:
         PlainSession( io_service_type *                io,
@@ -41,6 +43,49 @@ namespace token {
                        std::move( _remote ) ) {}
 
         tcp_type::socket &transport( ) { return this->sock; }
+
+        /**
+         * @brief Start processing requests; as HTTP/2 if the client opens with the connection
+         *        preface (h2c with prior knowledge), otherwise as HTTP/1.1
+         */
+        virtual void start( ) {
+          if ( this->route_config->getStreams( ) == 0 ) {
+            base_type::perform_read( );
+            return;
+          }
+
+          auto prefaced = http2_type::prefaced( this->buffer.data( ) );
+
+          if ( boost::indeterminate( prefaced ) ) {
+            // Keep getting more data till we're sure
+            this->sock.async_read_some(
+              this->buffer.prepare( NGHTTP2_CLIENT_MAGIC_LEN ),
+              networking::bind_executor( this->strand,
+                                         std::bind( &self_type::on_data, //
+                                                    this->shared_from_this( ),
+                                                    std::placeholders::_1,
+                                                    std::placeholders::_2 ) ) );
+          } else if ( prefaced ) {
+            this->upgrade( );
+          } else {
+            base_type::perform_read( );
+          }
+        }
+
+       protected:
+        /**
+         * @brief Process the data read while identifying the protocol
+         * @param ec boost error code
+         * @param received bytes received
+         */
+        void on_data( boost::system::error_code ec, std::size_t received ) {
+          if ( ec ) {
+            return; // Let the object die peacefully...
+          }
+
+          this->buffer.commit( received );
+          start( );
+        }
       };
     } // namespace http
   }   // namespace api
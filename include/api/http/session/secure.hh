@@ -2,6 +2,7 @@
 #define __SESSION_SECURE_HH_
 
 #include "api/http/session/basic.hh"
+#include "api/http/session/http2.hh"
 #include <boost/asio/ssl/stream.hpp>
 
 namespace token {
@@ -62,7 +63,8 @@ namespace token {
 
        protected:
         /**
-         * @brief Process the SSL handshake result, then start processing requests
+         * @brief Process the SSL handshake result, then start processing requests; as HTTP/2
+         *        if it was negotiated (ALPN), otherwise as HTTP/1.1
          * @param used bytes consumed
          * @param ec handshake processing error code
          */
@@ -77,7 +79,12 @@ namespace token {
 
           this->buffer.consume( used );
 
-          base_type::perform_read( );
+          if ( ( this->route_config->getStreams( ) ) &&
+               ( Http2< self_type, Traits >::negotiated( stream.native_handle( ) ) ) ) {
+            this->upgrade( );
+          } else {
+            base_type::perform_read( );
+          }
         }
 
         networking::ssl::stream< tcp_type::socket & > stream;
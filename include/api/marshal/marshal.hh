@@ -3,8 +3,8 @@
 
 #include "api/http.hh"
 //#include "api/http/rest.hh"
+#include "api/marshal/types/fields.hh"
 #include "api/marshal/types/state.hh"
-#include "api/marshal/types/status.hh"
 #include "api/marshal/types/token.hh"
 #include "token/api/manager.hh"
 
@@ -45,40 +45,43 @@ namespace token {
   namespace api {
     namespace marshal {
       class MarshalError : public std::exception {
-        const std::string &msg_;
+        std::string msg_;
 
        public:
-        MarshalError( const std::string &msg )
-          : msg_( msg ) {}
+        MarshalError( std::string msg )
+          : msg_( std::move( msg ) ) {}
 
         const char *what( ) const noexcept { return msg_.c_str( ); };
       };
 
       /**
        * Request / response value marshalling
+       *
+       * Values are carried between forms by the field descriptors (see fields::table), each
+       * form binding the fields it holds; the wire form through the Mapper, the token entry
+       * through token::table.  Values are moved on, not copied, so a marshalled value is
+       * handed to one destination only; marshal it from its source again to reuse it.
+       *
        * @param body_type message body type
+       * @param Mapper wire form; its read and write field tables, and get/set/clear of a field
        */
       template < typename BodyType, typename Mapper >
       struct Marshal {
         using body_type     = BodyType;
-        using wire_setter   = typename Mapper::setter;
-        using wire_getter   = typename Mapper::getter;
-        using status_getter = status::getter;
-        using token_setter  = token::setter;
-        using token_getter  = token::getter;
         using self          = Marshal< BodyType, Mapper >;
         using token_entry   = ::token::api::TokenEntry;
         using status_result = ::token::api::Status;
         using state_type    = detail::state;
-        using state_getter  = detail::state_getter;
-        using state_setter  = detail::state_setter;
+        using token_table   = ::token::api::marshal::token::table;
 
         state_type state;
 
         Marshal( ) {}
 
         explicit Marshal( const body_type &request ) { from( request ); }
+        explicit Marshal( body_type &&request ) { from( std::move( request ) ); }
         explicit Marshal( const token_entry &entry ) { from( entry ); }
+        explicit Marshal( token_entry &&entry ) { from( std::move( entry ) ); }
         explicit Marshal( const status_result &_status ) { from( _status ); }
 
         /**
@@ -138,8 +141,8 @@ namespace token {
             message = "Internal error";
           }
 
-          state_setter{ state }.error(
-            { { "message", message }, { "code", std::to_string( code ) } } );
+          state.clear( );
+          state.error = { { "message", std::move( message ) }, { "code", std::to_string( code ) } };
 
           return *this;
         }
@@ -149,23 +152,14 @@ namespace token {
          * @param request REST request body
          * @return this
          */
-        self &from( const body_type &request ) {
-          to( state_setter{ state }, wire_getter{ request } );
-
-          spdlog::trace( "Received from the client:" );
-          spdlog::trace( "UserID: {}", state.userId );
-          spdlog::trace( "Value: {}", state.value );
-          spdlog::trace( "Expiration: {}", state.expiration );
-          spdlog::trace( "Properties: {}", [ & ]( ) {
-            std::stringstream ss;
-            for ( auto &iter : state.properties ) {
-              ss << iter.first << "=" << iter.second << " ";
-            }
-            return ss.str( );
-          }( ) );
+        self &from( const body_type &request ) { return read( request ); }
 
-          return *this;
-        }
+        /**
+         * @brief Retrieve the values provided by the user, moving them out of the request
+         * @param request REST request body
+         * @return this
+         */
+        self &from( body_type &&request ) { return read( request ); }
 
         /**
          * @brief Proxy response values from the token governer
@@ -173,28 +167,30 @@ namespace token {
          * @return this
          */
         self &from( const token_entry &entry ) {
-          return to( state_setter{ state }, token_getter{ entry } );
+          state.clear( );
+          token_table::each( entry_reader< const token_entry >{ entry, state } );
+          return *this;
         }
 
         /**
-         * @brief Marshal the token governer status message
-         * @param status status value
+         * @brief Proxy response values from the token governer, moving them out of the entry
+         * @param entry token governer response entry
          * @return this
          */
-        self &from( const status_result &status ) {
-          return to( state_setter{ state }, status_getter{ status } );
+        self &from( token_entry &&entry ) {
+          state.clear( );
+          token_table::each( entry_reader< token_entry >{ entry, state } );
+          return *this;
         }
 
         /**
-         * @brief Copy results from one form to another
-         * @param dest destination
-         * @param src source
-         * return this
+         * @brief Marshal the token governer status message
+         * @param status status value
+         * @return this
          */
-        template < class Setter, class Getter >
-        self &to( Setter dest, Getter src ) {
-          dest.clear( );
-          dest.set( src );
+        self &from( const status_result &status ) {
+          state.clear( );
+          state.status = status.description( );
           return *this;
         }
 
@@ -204,7 +200,8 @@ namespace token {
          * @return this
          */
         self &to( token_entry &entry ) {
-          return to( token_setter{ entry }, state_getter{ state } );
+          token_table::each( entry_writer{ state, entry } );
+          return *this;
         }
 
         /**
@@ -213,7 +210,9 @@ namespace token {
          * @return this
          */
         self &to( body_type &response ) {
-          return to( wire_setter{ response }, state_getter{ state } );
+          Mapper::clear( response );
+          Mapper::write::each( wire_writer{ state, response } );
+          return *this;
         }
 
         /**
@@ -225,6 +224,89 @@ namespace token {
           state.token = std::move( _token );
           return *this;
         }
+
+       private:
+        /**
+         * @brief Retrieve the values provided by the user
+         * @param request REST request body; values are moved out of it if it isn't const
+         * @return this
+         */
+        template < typename Body >
+        self &read( Body &request ) {
+          state.clear( );
+          Mapper::read::each( wire_reader< Body >{ request, state } );
+
+          if ( spdlog::default_logger_raw( )->should_log( spdlog::level::trace ) ) {
+            spdlog::trace( "Received from the client:" );
+            spdlog::trace( "UserID: {}", state.userId );
+            spdlog::trace( "Value: {}", state.value );
+            spdlog::trace( "Expiration: {}", state.expiration );
+            spdlog::trace( "Properties: {}", [ & ]( ) {
+              std::stringstream ss;
+              for ( auto &iter : state.properties ) {
+                ss << iter.first << "=" << iter.second << " ";
+              }
+              return ss.str( );
+            }( ) );
+          }
+
+          return *this;
+        }
+
+        /** @brief Wire form -> state */
+        template < typename Body >
+        struct wire_reader {
+          Body &      body;
+          state_type &state;
+
+          template < typename Field >
+          void operator( )( Field field ) {
+            Mapper::get( body, field, Field::in( state ) );
+          }
+        };
+
+        /** @brief State -> wire form, of the values present */
+        struct wire_writer {
+          state_type &state;
+          body_type & body;
+
+          template < typename Field >
+          void operator( )( Field field ) {
+            auto &value = Field::in( state );
+
+            if ( !value.empty( ) ) {
+              Mapper::set( body, field, std::move( value ) );
+            }
+          }
+        };
+
+        /** @brief Token entry -> state */
+        template < typename Entry >
+        struct entry_reader {
+          Entry &     entry;
+          state_type &state;
+
+          template < typename Field >
+          void operator( )( Field ) {
+            ::token::api::marshal::token::assign( Field::in( state ),
+                                                  std::move( Field::of( entry ) ) );
+          }
+        };
+
+        /** @brief State -> token entry, of the values present */
+        struct entry_writer {
+          state_type & state;
+          token_entry &entry;
+
+          template < typename Field >
+          void operator( )( Field ) {
+            auto &value = Field::in( state );
+
+            if ( !value.empty( ) ) {
+              ::token::api::marshal::token::assign( Field::of( entry ), std::move( value ) );
+            }
+          }
+        };
       };
     } // namespace marshal
   }   // namespace api
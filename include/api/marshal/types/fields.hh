@@ -0,0 +1,103 @@
+#ifndef __MARSHAL_FIELDS_HH_
+#define __MARSHAL_FIELDS_HH_
+
+#include "api/marshal/types/state.hh"
+
+namespace token {
+  namespace api {
+    namespace marshal {
+      namespace fields {
+        /**
+         * @brief Field descriptor; its wire key (from the subclass) and marshalling state member
+         * @param Type value type
+         * @param Member state member holding the value
+         */
+        template < typename Type, Type detail::state::*Member >
+        struct field {
+          using type = Type;
+
+          /**
+           * @brief Access the field's value
+           * @param s marshalling state
+           * @return value
+           */
+          static type &in( detail::state &s ) { return s.*Member; }
+        };
+
+        /** Map valued fields' type */
+        using map_type = std::map< std::string, std::string >;
+
+        struct userId : field< std::string, &detail::state::userId > {
+          static const char *key( ) { return "userId"; }
+        };
+
+        struct token : field< std::string, &detail::state::token > {
+          static const char *key( ) { return "token"; }
+        };
+
+        struct value : field< std::string, &detail::state::value > {
+          static const char *key( ) { return "value"; }
+        };
+
+        struct mask : field< std::string, &detail::state::mask > {
+          static const char *key( ) { return "mask"; }
+        };
+
+        struct expiration : field< std::string, &detail::state::expiration > {
+          static const char *key( ) { return "expiration"; }
+        };
+
+        struct lastUsed : field< std::string, &detail::state::lastUsed > {
+          static const char *key( ) { return "lastUsed"; }
+        };
+
+        struct lastUpdated : field< std::string, &detail::state::lastUpdated > {
+          static const char *key( ) { return "lastUpdated"; }
+        };
+
+        struct status : field< std::string, &detail::state::status > {
+          static const char *key( ) { return "status"; }
+        };
+
+        struct error : field< map_type, &detail::state::error > {
+          static const char *key( ) { return "error"; }
+        };
+
+        struct properties : field< map_type, &detail::state::properties > {
+          static const char *key( ) { return "properties"; }
+        };
+
+        /**
+         * @brief Field descriptor table, visited at compile time
+         * @param Fields field descriptors
+         */
+        template < typename... Fields >
+        struct table {
+          /**
+           * @brief Visit each field, in order
+           * @param visitor called with each field descriptor (a value, for overloading on)
+           */
+          template < typename Visitor >
+          static void each( Visitor &&visitor ) {
+            int expand[] = { 0, ( visitor( Fields{ } ), 0 )... };
+            (void)expand;
+          }
+        };
+
+        /** Every field */
+        using all = table< userId,
+                           token,
+                           value,
+                           mask,
+                           expiration,
+                           lastUsed,
+                           lastUpdated,
+                           status,
+                           error,
+                           properties >;
+      } // namespace fields
+    }   // namespace marshal
+  }     // namespace api
+} // namespace token
+
+#endif // __MARSHAL_FIELDS_HH_
@@ -1,7 +1,7 @@
 #ifndef __TYPE_TOKEN_H_
 #define __TYPE_TOKEN_H_
 
-#include "api/marshal/types/base.hh"
+#include "api/marshal/types/fields.hh"
 #include <map>
 #include <memory.h>
 #include <string>
@@ -19,7 +19,7 @@ namespace token {
          * @param value date/time value
          * @return database date/time
          */
-        dbcpp::DBTime toTime( const std::string &value ) {
+        inline dbcpp::DBTime toTime( const std::string &value ) {
           struct tm tm = { 0 };
           strptime( value.c_str( ), "%FT%T%z", &tm );
           return ::dbcpp::DBTime{ std::chrono::seconds( mktime( &tm ) ) };
@@ -30,7 +30,7 @@ namespace token {
          * @param value database date/time
          * @return formatted date/time
          */
-        std::string fromTime( const ::dbcpp::DBTime value ) {
+        inline std::string fromTime( const ::dbcpp::DBTime value ) {
           struct tm _tm          = { 0 };
           char      block[ 128 ] = "";
           time_t    val          = ::dbcpp::DBClock::to_time_t( value );
@@ -49,39 +49,42 @@ namespace token {
           return block;
         }
 
-        struct getter : public base::getter {
-          const TokenEntry &entry;
-
-          explicit getter( const TokenEntry &entry_ )
-            : entry( entry_ ) {}
-
-          std::string                          token( ) { return entry.token; }
-          std::string                          value( ) { return entry.value; }
-          std::string                          mask( ) { return entry.mask; }
-          std::string                          expiration( ) { return fromTime( entry.expiration ); }
-          std::string                          lastUsed( ) { return ""; }    // fromTime( entry.lastUsed ); }
-          std::string                          lastUpdated( ) { return ""; } // fromTime( entry.lastUpdated ); }
-          std::map< std::string, std::string > properties( ) { return entry.properties; }
+        /**
+         * @brief Field descriptor bound to the token entry member holding its value
+         * @param Field field descriptor
+         * @param Member token entry member
+         */
+        template < typename Field, typename Type, Type TokenEntry::*Member >
+        struct bound : Field {
+          static Type &      of( TokenEntry &entry ) { return entry.*Member; }
+          static const Type &of( const TokenEntry &entry ) { return entry.*Member; }
         };
 
-        struct setter : public base::setter {
-          TokenEntry &entry;
-
-          explicit setter( TokenEntry &entry_ )
-            : entry( entry_ ) {}
+        /** Fields kept by a token entry (last used/updated aren't reported) */
+        using table =
+          fields::table< bound< fields::token, std::string, &TokenEntry::token >,
+                         bound< fields::value, std::string, &TokenEntry::value >,
+                         bound< fields::mask, std::string, &TokenEntry::mask >,
+                         bound< fields::expiration, ::dbcpp::DBTime, &TokenEntry::expiration >,
+                         bound< fields::properties, fields::map_type, &TokenEntry::properties > >;
 
-          void token( const std::string &token ) { entry.token = token; }
-          void value( const std::string &value ) { entry.value = value; }
-          void mask( const std::string &mask ) { entry.mask = mask; }
-          void expiration( const std::string &expiration ) { entry.expiration = toTime( expiration ); }
-          void properties( const std::map< std::string, std::string > &properties ) {
-            entry.properties.clear( );
+        /*
+         * Token entry member <- marshalled value
+         */
+        inline void assign( std::string &dest, std::string &&src ) { dest = std::move( src ); }
+        inline void assign( ::dbcpp::DBTime &dest, std::string &&src ) { dest = toTime( src ); }
+        inline void assign( fields::map_type &dest, fields::map_type &&src ) {
+          dest = std::move( src );
+        }
 
-            for ( auto &&pair : properties ) {
-              entry.properties[ pair.first ] = pair.second;
-            }
-          }
-        };
+        /*
+         * Marshalled value <- token entry member (moved from, or copied)
+         */
+        inline void assign( std::string &dest, const std::string &src ) { dest = src; }
+        inline void assign( std::string &dest, const ::dbcpp::DBTime &src ) {
+          dest = fromTime( src );
+        }
+        inline void assign( fields::map_type &dest, const fields::map_type &src ) { dest = src; }
       } // namespace token
     }   // namespace marshal
   }     // namespace api
@@ -0,0 +1,317 @@
+/* -*- Mode: c++ -*- */
+#ifndef __BASE64_HH__
+#define __BASE64_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define TOKEN_BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+namespace token {
+  namespace encoding {
+    namespace base64 {
+      namespace detail {
+        /** Sextet value of each input byte, -1 for anything outside the standard alphabet */
+        static const int8_t table[ 256 ] = {
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63, //
+          52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, //
+          -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, //
+          15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1, //
+          -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, //
+          41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+          -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+        };
+
+        /**
+         * @brief Decode complete quads, then the (unpadded) remainder
+         * @param in input characters (no padding)
+         * @param len number of input characters
+         * @param out output bytes
+         * @return number of bytes written, or -1 on malformed input
+         */
+        inline std::ptrdiff_t scalar( const uint8_t *in, size_t len, uint8_t *out ) {
+          uint8_t *start = out;
+          size_t   pos   = 0;
+
+          for ( ; pos + 4 <= len; pos += 4 ) {
+            int32_t a = table[ in[ pos + 0 ] ];
+            int32_t b = table[ in[ pos + 1 ] ];
+            int32_t c = table[ in[ pos + 2 ] ];
+            int32_t d = table[ in[ pos + 3 ] ];
+
+            if ( ( a | b | c | d ) < 0 ) {
+              return -1;
+            }
+
+            uint32_t v = ( a << 18 ) | ( b << 12 ) | ( c << 6 ) | d;
+
+            *( out++ ) = static_cast< uint8_t >( v >> 16 );
+            *( out++ ) = static_cast< uint8_t >( v >> 8 );
+            *( out++ ) = static_cast< uint8_t >( v );
+          }
+
+          switch ( len - pos ) {
+            case 0:
+              break;
+            case 2: {
+              int32_t a = table[ in[ pos + 0 ] ];
+              int32_t b = table[ in[ pos + 1 ] ];
+
+              if ( ( a | b ) < 0 ) {
+                return -1;
+              }
+
+              *( out++ ) = static_cast< uint8_t >( ( a << 2 ) | ( b >> 4 ) );
+              break;
+            }
+            case 3: {
+              int32_t a = table[ in[ pos + 0 ] ];
+              int32_t b = table[ in[ pos + 1 ] ];
+              int32_t c = table[ in[ pos + 2 ] ];
+
+              if ( ( a | b | c ) < 0 ) {
+                return -1;
+              }
+
+              uint32_t v = ( a << 10 ) | ( b << 4 ) | ( c >> 2 );
+
+              *( out++ ) = static_cast< uint8_t >( v >> 8 );
+              *( out++ ) = static_cast< uint8_t >( v );
+              break;
+            }
+            default: // A single dangling character can't encode anything
+              return -1;
+          }
+
+          return out - start;
+        }
+
+#if defined( TOKEN_BASE64_X86 )
+        /*
+         * Vector kernels: translate ASCII to sextets with nibble lookups (pshufb), validating
+         * every lane at the same time, then pack four sextets into three bytes with two
+         * multiply-adds and a byte shuffle.  Each kernel consumes whole blocks only and
+         * reports how much it consumed; the scalar path finishes the remainder.
+         */
+
+        /**
+         * @brief SSSE3 kernel; 16 characters to 12 bytes per step
+         * @note stores 16 bytes per step; the output needs 4 bytes of slack
+         */
+        __attribute__( ( target( "ssse3" ) ) ) inline size_t ssse3( const uint8_t *in,
+                                                                    size_t         len,
+                                                                    uint8_t *      out,
+                                                                    size_t *       written ) {
+          const __m128i shift_lut = _mm_setr_epi8( 0, 0, 19, 4, -65, -65, -71, -71, //
+                                                   0, 0, 0, 0, 0, 0, 0, 0 );
+          const __m128i mask_lut  = _mm_setr_epi8( ( char ) 0xa8, //
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf8,
+                                                  ( char ) 0xf0,
+                                                  ( char ) 0x54,
+                                                  ( char ) 0x50,
+                                                  ( char ) 0x50,
+                                                  ( char ) 0x50,
+                                                  ( char ) 0x54 );
+          const __m128i bit_lut   = _mm_setr_epi8( 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, //
+                                                 ( char ) 0x80,
+                                                 0, 0, 0, 0, 0, 0, 0, 0 );
+          const __m128i pack      = _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, //
+                                              -1, -1, -1, -1 );
+          size_t        pos       = 0;
+          uint8_t *     start     = out;
+
+          for ( ; pos + 16 <= len; pos += 16, out += 12 ) {
+            __m128i input = _mm_loadu_si128( reinterpret_cast< const __m128i * >( in + pos ) );
+            __m128i hi    = _mm_and_si128( _mm_srli_epi32( input, 4 ), _mm_set1_epi8( 0x0f ) );
+            __m128i lo    = _mm_and_si128( input, _mm_set1_epi8( 0x0f ) );
+            __m128i valid = _mm_and_si128( _mm_shuffle_epi8( mask_lut, lo ), //
+                                           _mm_shuffle_epi8( bit_lut, hi ) );
+
+            if ( _mm_movemask_epi8( _mm_cmpeq_epi8( valid, _mm_setzero_si128( ) ) ) ) {
+              break; // Let the scalar path report (or decode) it
+            }
+
+            // '/' shares its high nibble with '+', but needs 16 rather than 19
+            __m128i slash = _mm_cmpeq_epi8( input, _mm_set1_epi8( 0x2f ) );
+            __m128i shift = _mm_add_epi8( _mm_shuffle_epi8( shift_lut, hi ),
+                                          _mm_and_si128( slash, _mm_set1_epi8( -3 ) ) );
+            __m128i value = _mm_add_epi8( input, shift );
+
+            value = _mm_maddubs_epi16( value, _mm_set1_epi32( 0x01400140 ) );
+            value = _mm_madd_epi16( value, _mm_set1_epi32( 0x00011000 ) );
+            value = _mm_shuffle_epi8( value, pack );
+
+            _mm_storeu_si128( reinterpret_cast< __m128i * >( out ), value );
+          }
+
+          *written = out - start;
+          return pos;
+        }
+
+        /**
+         * @brief AVX2 kernel; 32 characters to 24 bytes per step
+         * @note stores 32 bytes per step; the output needs 8 bytes of slack
+         */
+        __attribute__( ( target( "avx2" ) ) ) inline size_t avx2( const uint8_t *in,
+                                                                  size_t         len,
+                                                                  uint8_t *      out,
+                                                                  size_t *       written ) {
+          const __m256i shift_lut = _mm256_setr_epi8( 0, 0, 19, 4, -65, -65, -71, -71, //
+                                                      0, 0, 0, 0, 0, 0, 0, 0,
+                                                      0, 0, 19, 4, -65, -65, -71, -71,
+                                                      0, 0, 0, 0, 0, 0, 0, 0 );
+          const __m256i mask_lut  = _mm256_setr_epi8( ( char ) 0xa8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf0,
+                                                     ( char ) 0x54,
+                                                     ( char ) 0x50,
+                                                     ( char ) 0x50,
+                                                     ( char ) 0x50,
+                                                     ( char ) 0x54,
+                                                     ( char ) 0xa8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf8,
+                                                     ( char ) 0xf0,
+                                                     ( char ) 0x54,
+                                                     ( char ) 0x50,
+                                                     ( char ) 0x50,
+                                                     ( char ) 0x50,
+                                                     ( char ) 0x54 );
+          const __m256i bit_lut   = _mm256_setr_epi8( 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, //
+                                                    ( char ) 0x80,
+                                                    0, 0, 0, 0, 0, 0, 0, 0,
+                                                    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+                                                    ( char ) 0x80,
+                                                    0, 0, 0, 0, 0, 0, 0, 0 );
+          const __m256i pack      = _mm256_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, //
+                                                 -1, -1, -1, -1,
+                                                 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                                 -1, -1, -1, -1 );
+          const __m256i lanes     = _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 3, 7 );
+          size_t        pos       = 0;
+          uint8_t *     start     = out;
+
+          for ( ; pos + 32 <= len; pos += 32, out += 24 ) {
+            __m256i input = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( in + pos ) );
+            __m256i nibble = _mm256_set1_epi8( 0x0f );
+            __m256i hi     = _mm256_and_si256( _mm256_srli_epi32( input, 4 ), nibble );
+            __m256i lo     = _mm256_and_si256( input, nibble );
+            __m256i valid  = _mm256_and_si256( _mm256_shuffle_epi8( mask_lut, lo ), //
+                                               _mm256_shuffle_epi8( bit_lut, hi ) );
+
+            if ( _mm256_movemask_epi8( _mm256_cmpeq_epi8( valid, _mm256_setzero_si256( ) ) ) ) {
+              break;
+            }
+
+            __m256i slash = _mm256_cmpeq_epi8( input, _mm256_set1_epi8( 0x2f ) );
+            __m256i shift = _mm256_add_epi8( _mm256_shuffle_epi8( shift_lut, hi ),
+                                             _mm256_and_si256( slash, _mm256_set1_epi8( -3 ) ) );
+            __m256i value = _mm256_add_epi8( input, shift );
+
+            value = _mm256_maddubs_epi16( value, _mm256_set1_epi32( 0x01400140 ) );
+            value = _mm256_madd_epi16( value, _mm256_set1_epi32( 0x00011000 ) );
+            value = _mm256_shuffle_epi8( value, pack );
+            value = _mm256_permutevar8x32_epi32( value, lanes ); // 12 + 12 bytes, contiguous
+
+            _mm256_storeu_si256( reinterpret_cast< __m256i * >( out ), value );
+          }
+
+          *written = out - start;
+          return pos;
+        }
+#endif
+      } // namespace detail
+
+      /** Output slack the vector kernels may write past the decoded data */
+      static const size_t slack = 8;
+
+      /**
+       * @brief Buffer size required to decode a value
+       * @param len encoded length
+       * @return output buffer size, including vector store slack
+       */
+      inline size_t capacity( size_t len ) { return ( len / 4 + 1 ) * 3 + slack; }
+
+      /**
+       * @brief Decode standard (RFC 4648) base64, with or without trailing padding
+       * @param src encoded characters
+       * @param len number of encoded characters
+       * @param dst output buffer
+       * @param size output buffer size, at least capacity( len )
+       * @return number of bytes decoded, or -1 if malformed (or the buffer is too small)
+       */
+      inline std::ptrdiff_t decode( const char *src, size_t len, char *dst, size_t size ) {
+        auto * in      = reinterpret_cast< const uint8_t * >( src );
+        auto * out     = reinterpret_cast< uint8_t * >( dst );
+        size_t done    = 0;
+        size_t written = 0;
+
+        if ( size < capacity( len ) ) {
+          return -1;
+        }
+
+        if ( len && ( len % 4 == 0 ) ) {
+          len -= ( in[ len - 1 ] == '=' );
+          len -= ( in[ len - 1 ] == '=' );
+        }
+
+#if defined( TOKEN_BASE64_X86 )
+        static const bool has_avx2  = __builtin_cpu_supports( "avx2" );
+        static const bool has_ssse3 = __builtin_cpu_supports( "ssse3" );
+
+        if ( has_avx2 && ( len >= 32 ) ) {
+          done = detail::avx2( in, len, out, &written );
+        }
+
+        if ( has_ssse3 && ( len - done >= 16 ) ) {
+          size_t more = 0;
+          done += detail::ssse3( in + done, len - done, out + written, &more );
+          written += more;
+        }
+#endif
+
+        std::ptrdiff_t rest = detail::scalar( in + done, len - done, out + written );
+
+        return ( rest < 0 ) ? -1 : static_cast< std::ptrdiff_t >( written ) + rest;
+      }
+    } // namespace base64
+  }   // namespace encoding
+} // namespace token
+
+#endif // __BASE64_HH__
@@ -2,24 +2,81 @@
 #ifndef __EXECUTOR_HH__
 #define __EXECUTOR_HH__
 
+#include "limiter.hh"
+#include "task.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
-#include <queue>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace token {
   namespace async {
 
+    /**
+     * @brief Scheduling class of an action
+     *
+     * Queued high priority actions are always taken before normal ones, and are never turned
+     * away by admit( ); keep them cheap (e.g. health checks and metrics scrapes).
+     */
+    enum class Priority : uint8_t {
+      high,   /**< Control plane */
+      normal, /**< Everything else */
+    };
+
+    /**
+     * @brief Work stealing thread pool
+     *
+     * Each worker has its own queue; work added from outside the pool is dealt round robin
+     * across the workers, work added by a worker stays on its own queue.  An idle worker steals
+     * from the others before going to sleep, and sleepers are only signalled when there are any,
+     * so no lock is shared by every submission and every worker.
+     *
+     * Each queue is split by Priority; workers drain the high priority work, their own and then
+     * others', before any normal work.  Within a priority, work is queued by flow (e.g. the user
+     * it is done for) and the flows take turns by deficit round robin, each getting a share in
+     * proportion to its weight (see weigh( )), so one busy flow can't starve the rest.  The
+     * turns are taken within each worker's queue, not across the pool: shares hold while work
+     * is dealt evenly, but a flow whose work piles up on one worker only competes there.
+     *
+     * The queues may be bounded (see bound( )); add( ) always queues, callers that can turn work
+     * away check admit( ) first.  How many workers run normal priority work at once may also be
+     * limited, adaptively (see limit( )); the rest wait in the queues.
+     *
+     * This replaces the single shared queue rather than sitting beside it, as the HTTP layer
+     * names Executor directly.  The per-worker queues are mutex guarded deques, not lock-free
+     * (Chase-Lev) ones: a Task is held by value with its callable stored inline, which a
+     * lock-free slot can't hold, and the per-flow queues above need more than push/pop/steal
+     * at the ends.  Each lock is only contended by its worker and the odd thief.
+     */
     class Executor {
      public:
       /** Asynchronous action */
-      using Runnable = std::function< void( void ) >;
-      /** Get the return type of a function */
+      using Runnable      = Task;
+      using clock_type    = std::chrono::steady_clock;
+      using time_type     = clock_type::time_point;
+      using duration_type = std::chrono::nanoseconds;
+      using priority_type = Priority;
+      /** Fair queuing flow identifier, 0 for work not done on anyone's behalf */
+      using flow_type = uint32_t;
+      /**
+       * Queue statistics; the queue depth when an action was taken, how long it had waited and
+       * the flow it was queued for
+       */
+      using observer_type =
+        std::function< void( size_t depth, duration_type wait, flow_type flow ) >;
+      /** Get the return type of a function, called with (stored copies of) its arguments */
       template < typename Function, typename... Args >
-      using result_type_t = typename std::result_of< Function( Args... ) >::type;
+      using result_type_t = typename std::result_of< typename std::decay< Function >::type &(
+        typename std::decay< Args >::type &... ) >::type;
 
       /**
        * @brief Default constructor, creates a thread pool based on the core count
@@ -37,27 +94,11 @@ namespace token {
         }
 
         for ( int num = 0; num < count; ++num ) {
-          pool.emplace_back( std::thread( [this] {
-            do {
-              Runnable runnable = nullptr;
-
-              {
-                std::unique_lock< std::mutex > guard( lock );
-                cond.wait( guard, [this]( ) { return ( !queue.empty( ) ) || ( !running( ) ); } );
-
-                if ( !running( ) ) {
-                  return;
-                }
-
-                runnable = queue.front( );
-                queue.pop( );
-              }
+          workers.emplace_back( new worker_type );
+        }
 
-              if ( runnable != nullptr ) {
-                runnable( );
-              }
-            } while ( running( ) );
-          } ) );
+        for ( size_t num = 0; num < workers.size( ); ++num ) {
+          pool.emplace_back( std::thread( &Executor::worker_main, this, num ) );
         }
       }
 
@@ -68,16 +109,24 @@ namespace token {
        */
       void halt( ) {
         if ( running( ) ) {
-          std::lock_guard< std::mutex > guard( lock );
-          while ( !queue.empty( ) ) {
-            queue.pop( );
+          for ( auto &worker : workers ) {
+            std::lock_guard< std::mutex > guard( worker->lock );
+            for ( size_t priority = 0; priority < priorities; ++priority ) {
+              queued[ priority ] -= worker->tasks[ priority ].size( );
+              pending -= worker->tasks[ priority ].size( );
+              worker->tasks[ priority ].clear( );
+            }
           }
+
+          std::lock_guard< std::mutex > guard( idleLock );
           done = true;
-          cond.notify_all( );
+          idleCond.notify_all( );
         }
 
         for ( auto &thread : pool ) {
-          thread.join( );
+          if ( thread.joinable( ) ) {
+            thread.join( );
+          }
         }
       }
 
@@ -87,23 +136,134 @@ namespace token {
        */
       bool running( ) { return !done; }
 
+      /**
+       * @brief Bound the queues
+       * @param depth maximum number of queued actions, 0 for no limit
+       * @param wait maximum time an action should wait to be run, 0 for no limit
+       * @note configure before adding work
+       */
+      void bound( size_t depth, duration_type wait ) {
+        maxDepth = depth;
+        maxWait  = wait;
+      }
+
+      /**
+       * @brief Observe queue statistics as actions are taken from the queues
+       * @param _observer statistics callback, called from the worker threads
+       * @note configure before adding work
+       */
+      void observe( observer_type _observer ) { observer = std::move( _observer ); }
+
+      /**
+       * @brief Weigh a flow's share of the workers against the others'
+       * @param flow flow identifier
+       * @param weight actions taken from the flow per turn, relative to other flows; flows not
+       *               weighed take 1 per turn
+       * @note configure before adding work
+       */
+      void weigh( flow_type flow, unsigned weight ) { weights[ flow ] = std::max( weight, 1u ); }
+
+      /**
+       * @brief Limit how much normal priority work runs at once
+       * @param _limiter concurrency limit, fed by sample( ); no more than the number of workers
+       *                 can run regardless
+       * @note configure before adding work
+       */
+      void limit( std::shared_ptr< AdaptiveLimit > _limiter ) {
+        std::lock_guard< std::mutex > guard( idleLock ); // Idle workers check it
+        limiter = std::move( _limiter );
+      }
+
+      /**
+       * @brief Account for the latency of an action, towards the concurrency limit
+       * @param latency how long the action took
+       */
+      void sample( duration_type latency ) {
+        if ( limiter ) {
+          limiter->sample( latency );
+        }
+      }
+
+      /**
+       * @brief Get the executor running the calling thread
+       * @return executor, or null if not called from a worker
+       */
+      static Executor *current( ) { return self( ).first; }
+
+      /**
+       * @brief Get the number of workers
+       * @return thread pool size
+       */
+      size_t size( ) const { return workers.size( ); }
+
+      /**
+       * @brief Get the number of queued actions
+       * @return queue depth, across all workers
+       */
+      size_t depth( ) const { return pending.load( std::memory_order_relaxed ); }
+
+      /**
+       * @brief Identify if another action should be queued
+       *
+       * Refused when the queues are full, or when work is currently waiting longer than allowed
+       * (a longer queue would only wait longer still).  High priority work is always admitted.
+       *
+       * @param priority scheduling class of the action
+       * @return true if within the bounds
+       */
+      bool admit( priority_type priority = priority_type::normal ) const {
+        if ( priority == priority_type::high ) {
+          return true;
+        }
+
+        auto count = depth( );
+
+        if ( ( maxDepth > 0 ) && ( count >= maxDepth ) ) {
+          return false;
+        }
+
+        auto wait = lastWait[ index( priority ) ].load( std::memory_order_relaxed );
+
+        return ( maxWait.count( ) <= 0 ) || ( count == 0 ) || ( duration_type( wait ) <= maxWait );
+      }
+
+      /**
+       * @brief Identify if an action has waited beyond the bound
+       * @param queued when the action was queued
+       * @return true if its result is likely no longer wanted
+       */
+      bool expired( time_type queued ) const {
+        return ( maxWait.count( ) > 0 ) && ( clock_type::now( ) - queued > maxWait );
+      }
+
       /**
        * @brief Add a method to call at another point in time
        * @param callable executable function
        */
       template < typename Function,
-                 typename Result                                                        = result_type_t< Function >,
+                 typename Result = result_type_t< Function >,
                  typename std::enable_if< std::is_void< Result >::value, void >::type * = nullptr >
-      void add( const Function &callable ) {
+      void add( Function &&callable ) {
+        add( priority_type::normal, 0, std::forward< Function >( callable ) );
+      }
+
+      /**
+       * @brief Add a method to call at another point in time
+       * @param priority scheduling class
+       * @param flow fair queuing flow
+       * @param callable executable function
+       */
+      template < typename Function,
+                 typename Result = result_type_t< Function >,
+                 typename std::enable_if< std::is_void< Result >::value, void >::type * = nullptr >
+      void add( priority_type priority, flow_type flow, Function &&callable ) {
         if ( running( ) ) {
           if ( pool.empty( ) ) {
             callable( );
             return;
           }
 
-          std::lock_guard< std::mutex > guard( lock );
-          queue.push( callable );
-          cond.notify_one( );
+          enqueue( priority, flow, Task( std::forward< Function >( callable ) ) );
         }
       }
 
@@ -117,36 +277,300 @@ namespace token {
                  typename Result = result_type_t< Function, Args... >,
                  typename std::enable_if< std::is_void< Result >::value, void >::type * = nullptr,
                  typename std::enable_if< sizeof...( Args ) != 0, void >::type *        = nullptr >
-      void add( const Function &callable, Args... args ) {
-        add( [=]( ) { callable( args... ); } );
+      void add( Function &&callable, Args &&... args ) {
+        add( std::bind( std::forward< Function >( callable ), std::forward< Args >( args )... ) );
       }
 
       /**
        * @brief Add a method to call at another point in time
        * @param callable executable function
        * @param args function arguments
+       * @return future result; exceptions thrown by the function are delivered through it
        */
       template < typename Function,
                  typename... Args,
                  typename Result = result_type_t< Function, Args... >,
                  typename std::enable_if< !std::is_void< Result >::value, void >::type * = nullptr >
-      std::future< Result > add( const Function &callable, Args... args ) {
-        auto pr = std::make_shared< std::promise< Result > >( );
-        add( [=]( ) { pr->set_value( callable( args... ) ); } );
-        return pr->get_future( );
+      std::future< Result > add( Function &&callable, Args &&... args ) {
+        std::packaged_task< Result( ) > task(
+          std::bind( std::forward< Function >( callable ), std::forward< Args >( args )... ) );
+        auto future = task.get_future( );
+
+        add( std::move( task ) );
+        return future;
       }
 
      protected:
+      /** Number of scheduling classes */
+      static constexpr size_t priorities = 2;
+
+      struct entry_type {
+        Task      task;
+        time_type queued;
+        flow_type flow;
+      };
+
+      /**
+       * @brief Deficit round robin queue
+       *
+       * Flows with queued work are visited in turn; a visit credits the flow with its weight and
+       * each action taken from it spends one credit, so a flow is served up to its weight before
+       * the next flow's turn.  An emptied flow is dropped, along with any unspent credit.
+       */
+      class queue_type {
+        struct flow_queue_type {
+          std::deque< entry_type > tasks;
+          unsigned                 deficit = 0;
+        };
+
+        std::unordered_map< flow_type, flow_queue_type > flows;
+        std::deque< flow_type >                          active; /**< Flows in turn order */
+        size_t                                           count = 0;
+
+       public:
+        size_t size( ) const { return count; }
+        bool   empty( ) const { return count == 0; }
+
+        void clear( ) {
+          flows.clear( );
+          active.clear( );
+          count = 0;
+        }
+
+        void push( entry_type &&entry ) {
+          auto &flow = flows[ entry.flow ];
+
+          if ( flow.tasks.empty( ) ) {
+            active.push_back( entry.flow );
+          }
+
+          flow.tasks.push_back( std::move( entry ) );
+          ++count;
+        }
+
+        /**
+         * @brief Take the next action due
+         * @param owner executor, for flow weights
+         * @param entry [out] action
+         * @return false if empty
+         */
+        bool pop( const Executor &owner, entry_type &entry ) {
+          while ( !active.empty( ) ) {
+            auto  found = flows.find( active.front( ) );
+            auto &flow  = found->second;
+
+            if ( flow.deficit > 0 ) {
+              entry = std::move( flow.tasks.front( ) );
+              flow.tasks.pop_front( );
+              --flow.deficit;
+              --count;
+
+              if ( flow.tasks.empty( ) ) {
+                flows.erase( found );
+                active.pop_front( );
+              }
+
+              return true;
+            }
+
+            flow.deficit = owner.weight( found->first );
+            active.push_back( active.front( ) );
+            active.pop_front( );
+          }
+
+          return false;
+        }
+      };
+
+      struct worker_type {
+        std::mutex lock;
+        queue_type tasks[ priorities ]; /**< By priority */
+        char       pad[ 64 ];           /**< Keep neighbouring workers off this cache line */
+      };
+
       /** Thread pool */
       std::vector< std::thread > pool;
-      /** Synchronization for the queue */
-      std::mutex lock;
-      /** Work queue */
-      std::queue< Runnable > queue;
+      /** Per thread work queues */
+      std::vector< std::unique_ptr< worker_type > > workers;
+      /** Next queue for work added from outside of the pool */
+      std::atomic< size_t > next{ 0 };
+      /** Number of queued actions, across all queues */
+      std::atomic< size_t > pending{ 0 };
+      /** Number of queued actions by priority, so empty classes needn't be searched */
+      std::atomic< size_t > queued[ priorities ] = { { 0 }, { 0 } };
+      /** Number of workers asleep (or about to be) */
+      std::atomic< size_t > sleepers{ 0 };
+      /** Sleeping worker synchronization */
+      std::mutex idleLock;
       /** Work item notification primitive */
-      std::condition_variable cond;
+      std::condition_variable idleCond;
       /** Completion flag */
-      bool done = false;
+      std::atomic< bool > done{ false };
+      /** Queue bounds, 0 for no limit */
+      size_t        maxDepth = 0;
+      duration_type maxWait{ 0 };
+      /** How long the most recently taken action of each priority waited (ns) */
+      std::atomic< int64_t > lastWait[ priorities ] = { { 0 }, { 0 } };
+      /** Queue statistics callback */
+      observer_type observer;
+      /** Fair queuing flow weights, by flow */
+      std::unordered_map< flow_type, unsigned > weights;
+      /** Normal priority concurrency limit; null for none */
+      std::shared_ptr< AdaptiveLimit > limiter;
+
+      /**
+       * @brief Get the executor and index of the calling worker
+       * @return executor (null if not a worker thread) and index into its workers
+       */
+      static std::pair< Executor *, size_t > &self( ) {
+        static thread_local std::pair< Executor *, size_t > worker{ nullptr, 0 };
+        return worker;
+      }
+
+      static size_t index( priority_type priority ) { return static_cast< size_t >( priority ); }
+
+      unsigned weight( flow_type flow ) const {
+        auto found = weights.find( flow );
+        return ( found == weights.end( ) ) ? 1 : found->second;
+      }
+
+      /**
+       * @brief Queue an action, waking a worker if any are asleep
+       * @param priority scheduling class
+       * @param flow fair queuing flow
+       * @param task action
+       */
+      void enqueue( priority_type priority, flow_type flow, Task &&task ) {
+        auto &caller = self( );
+        auto  slot   = ( caller.first == this ) ? caller.second
+                                                : next.fetch_add( 1, std::memory_order_relaxed );
+        auto &worker = *workers[ slot % workers.size( ) ];
+
+        {
+          std::lock_guard< std::mutex > guard( worker.lock );
+          worker.tasks[ index( priority ) ].push(
+            entry_type{ std::move( task ), clock_type::now( ), flow } );
+          queued[ index( priority ) ].fetch_add( 1 );
+          pending.fetch_add( 1 );
+        }
+
+        if ( sleepers.load( ) > 0 ) {
+          std::lock_guard< std::mutex > guard( idleLock );
+          idleCond.notify_one( );
+        }
+      }
+
+      /**
+       * @brief Take the next action of a priority from a queue
+       * @param worker queue owner
+       * @param priority scheduling class
+       * @param task [out] action
+       * @return true if an action was taken
+       */
+      bool take( worker_type &worker, size_t priority, Task &task ) {
+        entry_type entry;
+        size_t     queue = 0;
+
+        {
+          std::lock_guard< std::mutex > guard( worker.lock );
+
+          if ( !worker.tasks[ priority ].pop( *this, entry ) ) {
+            return false;
+          }
+
+          queued[ priority ].fetch_sub( 1 );
+          queue = pending.fetch_sub( 1 );
+        }
+
+        auto wait =
+          std::chrono::duration_cast< duration_type >( clock_type::now( ) - entry.queued );
+        lastWait[ priority ].store( wait.count( ), std::memory_order_relaxed );
+        task = std::move( entry.task );
+
+        if ( observer ) {
+          observer( queue, wait, entry.flow );
+        }
+
+        return true;
+      }
+
+      /**
+       * @brief Find an action, highest priority first; from this worker's queue first and then
+       *        the others'
+       * @param worker worker index
+       * @param task [out] action
+       * @param limited [out] true if the action counts against the concurrency limit
+       * @return true if an action was found
+       */
+      bool find( size_t worker, Task &task, bool &limited ) {
+        for ( size_t priority = 0; priority < priorities; ++priority ) {
+          if ( queued[ priority ].load( ) == 0 ) {
+            continue;
+          }
+
+          limited = limiter && ( priority != index( priority_type::high ) );
+
+          if ( limited && !limiter->acquire( ) ) {
+            continue;
+          }
+
+          for ( size_t num = 0; num < workers.size( ); ++num ) {
+            if ( take( *workers[ ( worker + num ) % workers.size( ) ], priority, task ) ) {
+              return true;
+            }
+          }
+
+          if ( limited ) {
+            limiter->release( );
+          }
+        }
+
+        return false;
+      }
+
+      /**
+       * @brief Identify if there's work a worker could take
+       * @return true if there is
+       */
+      bool ready( ) const {
+        if ( !limiter || limiter->available( ) ) {
+          return pending.load( ) > 0;
+        }
+
+        return queued[ index( priority_type::high ) ].load( ) > 0;
+      }
+
+      void worker_main( size_t worker ) {
+        self( ) = std::make_pair( this, worker );
+
+        while ( running( ) ) {
+          Task task;
+          bool limited = false;
+
+          if ( find( worker, task, limited ) ) {
+            task( );
+            task.reset( );
+
+            if ( limited ) {
+              limiter->release( );
+
+              // Room for another, which a sleeping worker may have been held back for
+              if ( sleepers.load( ) > 0 ) {
+                std::lock_guard< std::mutex > guard( idleLock );
+                idleCond.notify_one( );
+              }
+            }
+
+            continue;
+          }
+
+          std::unique_lock< std::mutex > guard( idleLock );
+
+          sleepers.fetch_add( 1 );
+          idleCond.wait( guard, [ this ]( ) { return ready( ) || !running( ); } );
+          sleepers.fetch_sub( 1 );
+        }
+      }
     };
   } // namespace async
 } // namespace token
@@ -0,0 +1,160 @@
+/* -*- Mode: c++ -*- */
+#ifndef __LIMITER_HH__
+#define __LIMITER_HH__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <mutex>
+
+namespace token {
+  namespace async {
+
+    /**
+     * @brief Adaptive concurrency limit, driven by observed latency
+     *
+     * Compares the average latency of recent work (a short window) with the lowest latency seen
+     * lately, which approximates the latency without contention.  While the two are within a
+     * tolerance there's headroom and the limit grows; beyond it work is queueing somewhere
+     * (threads, database connections, locks) and the limit shrinks in proportion (a gradient of
+     * lowest over recent).  A little room (the square root of the limit) is always left above
+     * the estimate, so the limit keeps probing for more throughput.
+     *
+     * The lowest latency is forgotten every so often, so the limit follows lasting changes
+     * (e.g. a larger table) rather than holding out for a latency that is no longer possible.
+     * The limit is only reconsidered while it is being used; an idle service keeps its limit.
+     */
+    class AdaptiveLimit {
+     public:
+      using clock_type    = std::chrono::steady_clock;
+      using duration_type = std::chrono::nanoseconds;
+
+     private:
+      /** Latency may rise this much over the lowest before the limit is cut */
+      static constexpr double tolerance = 2.0;
+      /** Weight of a new estimate against the current limit */
+      static constexpr double smoothing = 0.2;
+      /** Windows before the lowest latency is forgotten */
+      static constexpr size_t history = 50;
+      /** Minimum samples in a window */
+      static constexpr size_t samples = 10;
+
+      const size_t               minimum;
+      const size_t               maximum;
+      const clock_type::duration window;
+
+      std::atomic< size_t > current;
+      std::atomic< size_t > inflight{ 0 };
+
+      std::mutex             sampleLock;
+      double                 estimate;      /**< Unrounded limit */
+      double                 lowest    = 0; /**< Lowest latency seen lately (ns), 0 if none */
+      double                 windowLow = 0; /**< Lowest latency in the current window (ns) */
+      double                 shortSum  = 0; /**< Total latency in the current window (ns) */
+      size_t                 count     = 0; /**< Samples in the current window */
+      size_t                 peak      = 0; /**< Most work in flight in the current window */
+      size_t                 windows   = 0; /**< Windows since the lowest was forgotten */
+      clock_type::time_point started   = clock_type::now( );
+
+     public:
+      /**
+       * @param initial starting limit
+       * @param _minimum lowest limit
+       * @param _maximum highest limit
+       * @param _window how often the limit is reconsidered
+       */
+      AdaptiveLimit( size_t               initial,
+                     size_t               _minimum,
+                     size_t               _maximum,
+                     clock_type::duration _window = std::chrono::milliseconds( 250 ) )
+        : minimum( std::max< size_t >( _minimum, 1 ) )
+        , maximum( std::max( _maximum, minimum ) )
+        , window( _window )
+        , current( std::min( std::max( initial, minimum ), maximum ) )
+        , estimate( current.load( ) ) {}
+
+      AdaptiveLimit( const AdaptiveLimit & ) = delete;
+      AdaptiveLimit &operator=( const AdaptiveLimit & ) = delete;
+
+      /**
+       * @brief Get the current limit
+       * @return concurrent work allowed
+       */
+      size_t limit( ) const { return current.load( std::memory_order_relaxed ); }
+
+      /**
+       * @brief Identify if there's room for more work
+       * @return true if under the limit
+       */
+      bool available( ) const { return inflight.load( ) < limit( ); }
+
+      /**
+       * @brief Start work, if there's room
+       * @return true if started; release( ) once done
+       */
+      bool acquire( ) {
+        if ( inflight.fetch_add( 1 ) < limit( ) ) {
+          return true;
+        }
+
+        inflight.fetch_sub( 1 );
+        return false;
+      }
+
+      /**
+       * @brief Finish work started by acquire( )
+       */
+      void release( ) { inflight.fetch_sub( 1 ); }
+
+      /**
+       * @brief Account for the latency of completed work
+       * @param latency how long the work took
+       */
+      void sample( duration_type latency ) {
+        std::lock_guard< std::mutex > guard( sampleLock );
+        auto                          now = clock_type::now( );
+        auto                          rtt = std::max< double >( latency.count( ), 1 );
+
+        shortSum += rtt;
+        windowLow = ( count == 0 ) ? rtt : std::min( windowLow, rtt );
+        peak      = std::max( peak, inflight.load( std::memory_order_relaxed ) + 1 );
+
+        if ( ( ++count < samples ) || ( now - started < window ) ) {
+          return;
+        }
+
+        auto shortRtt = shortSum / count;
+        auto used     = peak;
+
+        if ( ( lowest == 0 ) || ( ++windows >= history ) ) {
+          lowest  = windowLow;
+          windows = 0;
+        } else {
+          lowest = std::min( lowest, windowLow );
+        }
+
+        shortSum = 0;
+        count    = 0;
+        peak     = 0;
+        started  = now;
+
+        if ( used * 2 < estimate ) {
+          // Too little work to judge the limit by
+          return;
+        }
+
+        auto gradient = std::max( 0.5, std::min( 1.0, tolerance * lowest / shortRtt ) );
+        auto target   = estimate * gradient + std::sqrt( estimate );
+
+        estimate = estimate * ( 1 - smoothing ) + target * smoothing;
+        estimate = std::max< double >( minimum, std::min< double >( maximum, estimate ) );
+
+        current.store( static_cast< size_t >( estimate ), std::memory_order_relaxed );
+      }
+    };
+  } // namespace async
+} // namespace token
+
+#endif // __LIMITER_HH__
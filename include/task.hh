@@ -0,0 +1,161 @@
+/* -*- Mode: c++ -*- */
+#ifndef __TASK_HH__
+#define __TASK_HH__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace token {
+  namespace async {
+
+    /**
+     * @brief Move-only, type erased, nullary action
+     *
+     * Unlike std::function the callable need not be copyable, and callables up to `capacity`
+     * bytes are stored inline, so queuing one doesn't allocate; larger callables are moved to
+     * the heap.
+     */
+    class Task {
+     public:
+      /** Inline storage size; a bound session request (see Session::perform) fits */
+      static constexpr size_t capacity = 128;
+
+     private:
+      using storage_type = typename std::aligned_storage< capacity, alignof( void * ) >::type;
+
+      struct ops_type {
+        void ( *invoke )( void *storage );
+        void ( *move )( void *to, void *from ); /**< Move construct, then destroy the source */
+        void ( *destroy )( void *storage );
+      };
+
+      template < typename Function >
+      struct inline_ops {
+        static void invoke( void *storage ) { ( *static_cast< Function * >( storage ) )( ); }
+        static void move( void *to, void *from ) {
+          new ( to ) Function( std::move( *static_cast< Function * >( from ) ) );
+          destroy( from );
+        }
+        static void destroy( void *storage ) { static_cast< Function * >( storage )->~Function( ); }
+
+        static const ops_type ops;
+      };
+
+      template < typename Function >
+      struct heap_ops {
+        static Function *&target( void *storage ) { return *static_cast< Function ** >( storage ); }
+        static void       invoke( void *storage ) { ( *target( storage ) )( ); }
+        static void       move( void *to, void *from ) {
+          new ( to ) Function *( target( from ) );
+          target( from ) = nullptr;
+        }
+        static void destroy( void *storage ) { delete target( storage ); }
+
+        static const ops_type ops;
+      };
+
+      storage_type    storage;
+      const ops_type *ops = nullptr;
+
+      template < typename Function >
+      void assign( Function &&callable, std::true_type ) {
+        using function_type = typename std::decay< Function >::type;
+        new ( &storage ) function_type( std::forward< Function >( callable ) );
+        ops = &inline_ops< function_type >::ops;
+      }
+
+      template < typename Function >
+      void assign( Function &&callable, std::false_type ) {
+        using function_type = typename std::decay< Function >::type;
+        auto target = new function_type( std::forward< Function >( callable ) );
+        new ( &storage ) function_type *( target );
+        ops = &heap_ops< function_type >::ops;
+      }
+
+     public:
+      /**
+       * @brief Identify if a callable is stored inline, rather than moved to the heap
+       * @param Function callable type
+       */
+      template < typename Function >
+      using fits =
+        std::integral_constant< bool,
+                                ( sizeof( Function ) <= capacity ) &&
+                                  ( alignof( Function ) <= alignof( storage_type ) ) &&
+                                  std::is_nothrow_move_constructible< Function >::value >;
+
+      Task( ) = default;
+      Task( std::nullptr_t ) {}
+
+      template < typename Function,
+                 typename = typename std::enable_if<
+                   !std::is_same< typename std::decay< Function >::type, Task >::value >::type >
+      Task( Function &&callable ) {
+        assign( std::forward< Function >( callable ),
+                fits< typename std::decay< Function >::type >{ } );
+      }
+
+      Task( Task &&other ) noexcept {
+        if ( other.ops ) {
+          other.ops->move( &storage, &other.storage );
+          ops       = other.ops;
+          other.ops = nullptr;
+        }
+      }
+
+      Task &operator=( Task &&other ) noexcept {
+        if ( this != &other ) {
+          reset( );
+
+          if ( other.ops ) {
+            other.ops->move( &storage, &other.storage );
+            ops       = other.ops;
+            other.ops = nullptr;
+          }
+        }
+
+        return *this;
+      }
+
+      Task( const Task & ) = delete;
+      Task &operator=( const Task & ) = delete;
+
+      ~Task( ) { reset( ); }
+
+      /**
+       * @brief Release the held callable
+       */
+      void reset( ) {
+        if ( ops ) {
+          ops->destroy( &storage );
+          ops = nullptr;
+        }
+      }
+
+      explicit operator bool( ) const { return ops != nullptr; }
+
+      /**
+       * @brief Run the held callable
+       */
+      void operator( )( ) { ops->invoke( &storage ); }
+    };
+
+    template < typename Function >
+    const Task::ops_type Task::inline_ops< Function >::ops = {
+      &Task::inline_ops< Function >::invoke,
+      &Task::inline_ops< Function >::move,
+      &Task::inline_ops< Function >::destroy,
+    };
+
+    template < typename Function >
+    const Task::ops_type Task::heap_ops< Function >::ops = {
+      &Task::heap_ops< Function >::invoke,
+      &Task::heap_ops< Function >::move,
+      &Task::heap_ops< Function >::destroy,
+    };
+  } // namespace async
+} // namespace token
+
+#endif // __TASK_HH__
@@ -0,0 +1,16 @@
+
+CREATE OR REPLACE FUNCTION acl_changed( ) RETURNS trigger AS $$
+BEGIN
+  --
+  -- Bump the table generation so every node reloads its access snapshot
+  --
+  UPDATE acl_versions
+     SET version = version + 1
+   WHERE tablename = TG_TABLE_NAME;
+
+  IF NOT FOUND THEN
+    INSERT INTO acl_versions ( tablename, version ) VALUES ( TG_TABLE_NAME, 1 );
+  END IF;
+
+  RETURN NULL;
+END $$ LANGUAGE plpgsql;
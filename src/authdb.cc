@@ -1,13 +1,123 @@
 #include "authdb.hh"
+#include "base64.hh"
+#include <cstring>
 #include <iostream>
-#include <openssl/bio.h>
-#include <openssl/evp.h>
+#include <spdlog/spdlog.h>
+#include <type_traits>
 
+#include "acl-1.h"
+#include "authorize-1.h"
 #include "ratelimit-1.h"
 #include "ratelimit-2.h"
+#include "ratelimit-3.h"
+#include "ratelimit-4.h"
+#include "statement-1.h"
+#include "statement-2.h"
+#include "statement-3.h"
 
 namespace token {
   namespace app {
+    namespace {
+      /** Server functions, the statements' and the ACL trigger's; see install( ) */
+      const uint8_t *const functions[] = {
+        ratelimit_1_sql, ratelimit_2_sql, ratelimit_3_sql, ratelimit_4_sql,
+        authorize_1_sql, statement_1_sql, statement_2_sql, statement_3_sql, acl_1_sql,
+      };
+
+      /** Indexed by AuthTokenDB::statement_id */
+      const char *const statements[] = {
+        "SELECT user_creds_id( ?, ? )",
+        "SELECT user_token_id( ? )",
+        "SELECT user_vault_access( ?::integer, ? )",
+        "SELECT uid, access::integer, allowed FROM authorize_and_limit( ?, ?, ?, ?::integer )",
+        "SELECT user_limit( ?::integer, ?, ?::integer )",
+        "SELECT user_limit_lease( ?::integer, ?::integer )",
+        "SELECT user_limit_release( ?::integer, ?::integer )",
+      };
+
+      /**
+       * @brief Identify a statement failing because its function is missing, in which case
+       *        nothing ran (e.g. the database was restored from before it was installed)
+       *
+       * dbcpp only passes on the server's message, not its SQLSTATE (42883, undefined_function),
+       * so this matches the message: the code where verbose error reporting includes it, the
+       * English text otherwise. Under a non-English lc_messages a missing function isn't
+       * recognised and the statement fails instead of being reinstalled.
+       *
+       * @param ex statement failure
+       * @return true if the function doesn't exist
+       */
+      bool undefined( const std::exception &ex ) {
+        boost::string_view what( ex.what( ) );
+        return ( what.find( "42883" ) != what.npos ) ||
+               ( ( what.find( "function" ) != what.npos ) &&
+                 ( what.find( "does not exist" ) != what.npos ) );
+      }
+
+      template < size_t I, typename ResultSet, typename... Columns >
+      typename std::enable_if< I == sizeof...( Columns ) >::type
+      columns( ResultSet &, std::tuple< Columns &... > & ) {}
+
+      /**
+       * @brief Read a result row into variables
+       * @param rs result set, on the row
+       * @param row [out] a variable per column, in order
+       */
+      template < size_t I, typename ResultSet, typename... Columns >
+      typename std::enable_if< ( I < sizeof...( Columns ) ) >::type
+      columns( ResultSet &rs, std::tuple< Columns &... > &row ) {
+        using column_type = typename std::tuple_element< I, std::tuple< Columns... > >::type;
+
+        std::get< I >( row ) = rs.template get< column_type >( I );
+        columns< I + 1 >( rs, row );
+      }
+
+      /** Decoded Basic credentials that fit here never touch the heap */
+      constexpr size_t basic_stack = 512;
+
+      /**
+       * @brief Decode Basic credentials and split them into user and password
+       * @param encoded base64 encoded "user:password"
+       * @param buffer decode buffer
+       * @param size decode buffer size
+       * @param spill used in place of buffer when the credentials don't fit
+       * @param user [out] user name, referencing the decode buffer
+       * @param pass [out] password, referencing the decode buffer
+       * @return false if the credentials are malformed
+       */
+      bool basic_credentials( const std::string & encoded,
+                              char *               buffer,
+                              size_t               size,
+                              std::vector< char > &spill,
+                              boost::string_view & user,
+                              boost::string_view & pass ) {
+        namespace base64 = token::encoding::base64;
+
+        if ( base64::capacity( encoded.size( ) ) > size ) {
+          spill.resize( base64::capacity( encoded.size( ) ) );
+          buffer = spill.data( );
+          size   = spill.size( );
+        }
+
+        auto len = base64::decode( encoded.data( ), encoded.size( ), buffer, size );
+
+        if ( len < 0 ) {
+          return false;
+        }
+
+        auto colon = static_cast< char * >( memchr( buffer, ':', len ) );
+
+        if ( !colon ) {
+          return false;
+        }
+
+        user = boost::string_view( buffer, colon - buffer );
+        pass = boost::string_view( colon + 1, buffer + len - colon - 1 );
+
+        return true;
+      }
+    } // namespace
+
     void AuthTokenDB::init( ) {
       auto connection = dbPool.getConnection( );
       bool commit     = false;
@@ -99,20 +209,393 @@ namespace token {
         commit = true;
       }
 
-      if ( !( connection << "SELECT 1 FROM pg_proc WHERE proname = ?"
-                         << "user_limit" )
+      // Replaced whether installed or not, so fixed definitions (e.g. user_limit( ) joining
+      // vaults on the wrong id) reach existing databases; commits the tables above too
+      install( connection );
+
+      if ( !( connection << "SELECT 1 FROM pg_tables WHERE tablename = ?"
+                         << "acl_versions" )
               .executeQuery( )
               .next( ) ) {
-        ( connection << ( std::string{ ( char * ) ratelimit_1_sql } ) ).execute( );
-        ( connection << ( std::string{ ( char * ) ratelimit_2_sql } ) ).execute( );
+        ( connection << ( "CREATE TABLE acl_versions ("
+                          "  tablename  VARCHAR(63) PRIMARY KEY,"
+                          "  version    BIGINT NOT NULL DEFAULT 0"
+                          ")" ) )
+          .execute( );
         commit = true;
       }
 
+      for ( auto &&table : { "users", "vaults", "user_vaults", "user_limits_config" } ) {
+        auto trigger = fmt::format( "{}_acl_changed", table );
+
+        if ( !( connection << "SELECT 1 FROM pg_trigger WHERE tgname = ?" << trigger )
+                .executeQuery( )
+                .next( ) ) {
+          ( connection << fmt::format( "CREATE TRIGGER {} "
+                                       "AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON {} "
+                                       "FOR EACH STATEMENT EXECUTE PROCEDURE acl_changed( )",
+                                       trigger,
+                                       table ) )
+            .execute( );
+          commit = true;
+        }
+      }
+
       if ( commit ) {
         connection.commit( );
       }
     }
 
+    AuthTokenDB::~AuthTokenDB( ) {
+      {
+        std::lock_guard< std::mutex > guard( aclLock );
+        aclDone = true;
+        aclCond.notify_all( );
+      }
+
+      if ( aclThread.joinable( ) ) {
+        aclThread.join( );
+      }
+    }
+
+    void AuthTokenDB::acl_start( std::chrono::milliseconds interval, bool local_limits ) {
+      if ( ( interval.count( ) <= 0 ) || ( aclThread.joinable( ) ) ) {
+        return;
+      }
+
+      localLimits = local_limits;
+      aclThread   = std::thread( [this, interval]( ) {
+        std::unique_lock< std::mutex > guard( aclLock );
+
+        do {
+          guard.unlock( );
+
+          try {
+            acl_refresh( );
+          } catch ( std::exception &ex ) {
+            spdlog::error( "Unable to refresh the vault access snapshot: {}", ex.what( ) );
+          }
+
+          try {
+            limits_flush( );
+          } catch ( std::exception &ex ) {
+            spdlog::error( "Unable to record rate limit usage: {}", ex.what( ) );
+          }
+
+          guard.lock( );
+        } while ( !aclCond.wait_for( guard, interval, [this]( ) { return aclDone; } ) );
+
+        try {
+          limits_flush( );
+        } catch ( std::exception &ex ) {
+          spdlog::error( "Unable to record rate limit usage: {}", ex.what( ) );
+        }
+      } );
+    }
+
+    void AuthTokenDB::metrics( prometheus::Registry &registry ) {
+      auto &family = prometheus::BuildCounter( )
+                       .Name( "db_statements" )
+                       .Help( "Authorization statements executed, and their functions reinstalled" )
+                       .Register( registry );
+
+      stmtInstalled = &family.Add( { { "kind", "install" } } );
+      stmtExecuted  = &family.Add( { { "kind", "execute" } } );
+    }
+
+    template < typename Connection >
+    void AuthTokenDB::install( Connection &connection ) {
+      for ( auto function : functions ) {
+        ( connection << std::string{ ( char * ) function } ).execute( );
+      }
+
+      connection.commit( );
+
+      if ( stmtInstalled ) {
+        stmtInstalled->Increment( );
+      }
+    }
+
+    template < typename... Columns, typename... Args >
+    bool AuthTokenDB::query( statement_id               id,
+                             std::tuple< Columns &... > row,
+                             const Args &... args ) {
+      auto connection = dbPool.getConnection( );
+
+      for ( int attempt = 0;; ++attempt ) {
+        try {
+          auto statement = connection << statements[ id ];
+          int  bind[]    = { 0, ( ( void ) ( statement << args ), 0 )... };
+          auto rs        = statement.executeQuery( );
+          bool found     = rs.next( );
+
+          ( void ) bind;
+
+          if ( found ) {
+            columns< 0 >( rs, row );
+          }
+
+          connection.commit( );
+
+          if ( stmtExecuted ) {
+            stmtExecuted->Increment( );
+          }
+
+          return found;
+        } catch ( std::exception &ex ) {
+          connection.rollback( );
+
+          // Anything else may have applied the statement (e.g. taken a lease), so only this
+          // is retried
+          if ( attempt || !undefined( ex ) ) {
+            throw;
+          }
+
+          spdlog::warn( "Reinstalling the authorization functions: {}", ex.what( ) );
+          install( connection );
+        }
+      }
+    }
+
+    template < typename... Args >
+    int32_t AuthTokenDB::execute( statement_id id, const Args &... args ) {
+      int32_t value = 0;
+
+      query( id, std::tie( value ), args... );
+      return value;
+    }
+
+    void AuthTokenDB::lease_start( uint32_t size, std::chrono::milliseconds ttl ) {
+      leaseSize = size;
+      leaseTtl  = ttl;
+    }
+
+    /*
+     * Polls acl_versions (bumped by the acl_changed triggers) and reloads, whole, each map whose
+     * tables changed; unchanged maps are carried over into the new snapshot.
+     */
+    void AuthTokenDB::acl_refresh( ) {
+      bool initial = !acl.snapshot( );
+      bool users   = false;
+      bool grants  = initial;
+      bool vaults  = initial;
+      bool limits  = initial;
+
+      std::unordered_map< std::string, int64_t > versions;
+
+      {
+        auto connection = dbPool.getConnection( );
+        auto statement  = connection << "SELECT tablename, version FROM acl_versions";
+        auto rs         = statement.executeQuery( );
+
+        while ( rs.next( ) ) {
+          versions[ rs.get< std::string >( 0 ) ] = rs.get< int64_t >( 1 );
+        }
+
+        for ( auto &&version : versions ) {
+          if ( aclVersions[ version.first ] != version.second ) {
+            users |= version.first == "users";
+            grants |= ( version.first == "users" ) || ( version.first == "user_vaults" );
+            vaults |= version.first == "vaults";
+            limits = true;
+          }
+        }
+
+        std::shared_ptr< AclSnapshot::grant_map > grant_map;
+        std::shared_ptr< AclSnapshot::vault_map > vault_map;
+
+        if ( grants ) {
+          auto grs  = ( connection << "SELECT userid, vault FROM user_vaults" ).executeQuery( );
+          grant_map = std::make_shared< AclSnapshot::grant_map >( );
+
+          while ( grs.next( ) ) {
+            ( *grant_map )[ grs.get< int32_t >( 0 ) ].insert( grs.get< int32_t >( 1 ) );
+          }
+        }
+
+        if ( vaults ) {
+          auto vrs  = ( connection << "SELECT id, alias, tablename FROM vaults" ).executeQuery( );
+          vault_map = std::make_shared< AclSnapshot::vault_map >( );
+
+          while ( vrs.next( ) ) {
+            auto id = vrs.get< int32_t >( 0 );
+
+            ( *vault_map )[ std::to_string( id ) ]        = id;
+            ( *vault_map )[ vrs.get< std::string >( 1 ) ] = id;
+            ( *vault_map )[ vrs.get< std::string >( 2 ) ] = id;
+          }
+        }
+
+        if ( grants || vaults ) {
+          acl.publish( std::move( grant_map ), std::move( vault_map ) );
+        }
+      }
+
+      if ( limits && localLimits ) {
+        limits_load( );
+      }
+
+      aclVersions = std::move( versions );
+
+      if ( users && !initial ) {
+        // Passwords or tokens may have changed out from under us (e.g. another node)
+        userGeneration.fetch_add( 1, std::memory_order_release );
+
+        if ( authCache ) {
+          authCache->clear( );
+        }
+      }
+    }
+
+    void AuthTokenDB::limits_load( ) {
+      auto prior   = limiter.snapshot( );
+      auto buckets = std::make_shared< RateLimiter::bucket_map >( );
+
+      // Anything consumed against a bucket about to be replaced must be recorded first
+      limits_flush( );
+
+      auto connection = dbPool.getConnection( );
+      auto statement =
+        connection << "SELECT ulc.id, uv.userid, uv.vault, v.tablename, ulc.value,"
+                      "       ( EXTRACT( EPOCH FROM ulc.period ) * 1000 )::bigint,"
+                      "       CASE WHEN ul.expire > now( ) THEN ulc.value - ul.value ELSE 0 END"
+                      "  FROM user_limits_config ulc"
+                      " INNER JOIN user_vaults uv ON uv.id = ulc.uvault_id"
+                      " INNER JOIN vaults      v  ON v.id  = uv.vault"
+                      "  LEFT JOIN user_limits ul ON ul.config_id = ulc.id";
+      auto rs = statement.executeQuery( );
+
+      while ( rs.next( ) ) {
+        auto    configId = rs.get< int32_t >( 0 );
+        auto    uid      = rs.get< int32_t >( 1 );
+        auto    key      = RateLimiter::key( uid, rs.get< int32_t >( 2 ) );
+        auto    value    = rs.get< int32_t >( 4 );
+        int64_t period   = rs.get< int64_t >( 5 ) * 1000000;
+
+        if ( prior ) {
+          auto existing = prior->find( key );
+
+          if ( ( existing != prior->end( ) ) &&                     //
+               ( existing->second->configId == configId ) &&        //
+               ( existing->second->value == ( uint32_t ) value ) && //
+               ( existing->second->period == period ) ) {
+            ( *buckets )[ key ] = existing->second;
+            continue;
+          }
+        }
+
+        auto bucket = std::make_shared< LimitBucket >( configId, //
+                                                       uid,
+                                                       rs.get< std::string >( 3 ),
+                                                       value,
+                                                       period );
+        bucket->charge( rs.get< int32_t >( 6 ) );
+        ( *buckets )[ key ] = std::move( bucket );
+      }
+
+      limiter.publish( buckets );
+
+      if ( prior ) {
+        for ( auto &&entry : *prior ) {
+          auto current = buckets->find( entry.first );
+
+          if ( ( current == buckets->end( ) ) || ( current->second != entry.second ) ) {
+            lease_release( *entry.second );
+          }
+        }
+      }
+    }
+
+    void AuthTokenDB::limits_flush( ) {
+      auto buckets = limiter.snapshot( );
+
+      if ( !buckets ) {
+        return;
+      }
+
+      if ( leaseSize ) {
+        auto now = LimitBucket::now( );
+
+        // Usage was recorded when the lease was taken; just hand back what has gone stale
+        for ( auto &&entry : *buckets ) {
+          if ( entry.second->leaseExpire.load( ) < now ) {
+            lease_release( *entry.second );
+          }
+        }
+
+        return;
+      }
+
+      for ( auto &&entry : *buckets ) {
+        auto &   bucket = *entry.second;
+        uint32_t used   = bucket.consumed.exchange( 0 );
+
+        if ( !used ) {
+          continue;
+        }
+
+        try {
+          execute( STMT_USER_LIMIT, bucket.uid, bucket.vault, used );
+        } catch ( ... ) {
+          bucket.consumed.fetch_add( used );
+          throw;
+        }
+      }
+    }
+
+    uint32_t AuthTokenDB::lease( LimitBucket &bucket, uint32_t count ) {
+      uint32_t got = bucket.take( count );
+
+      if ( got == count ) {
+        return got;
+      }
+
+      std::lock_guard< std::mutex > guard( bucket.leaseLock );
+      auto                          now = LimitBucket::now( );
+
+      // Someone else may have just renewed the lease, or learnt there is nothing left
+      got += bucket.take( count - got );
+
+      if ( ( got == count ) || ( bucket.exhausted.load( ) > now ) ) {
+        return got;
+      }
+
+      auto     want    = std::max( leaseSize, count - got );
+      uint32_t granted = 0;
+
+      try {
+        query( STMT_LIMIT_LEASE, std::tie( granted ), bucket.configId, want );
+      } catch ( std::exception &ex ) {
+        spdlog::error( "Unable to reserve rate limit allowance: {}", ex.what( ) );
+        return count; // Same as rate_limit( ) failing against the database
+      }
+
+      auto used = std::min( granted, count - got );
+
+      if ( granted < want ) {
+        // The period's allowance is spent; stop asking until the lease would have expired
+        bucket.exhausted.store( now + std::chrono::nanoseconds( leaseTtl ).count( ) );
+      }
+
+      if ( granted > used ) {
+        bucket.leased.fetch_add( granted - used );
+        bucket.leaseExpire.store( now + std::chrono::nanoseconds( leaseTtl ).count( ) );
+      }
+
+      return got + used;
+    }
+
+    void AuthTokenDB::lease_release( LimitBucket &bucket ) {
+      std::lock_guard< std::mutex > guard( bucket.leaseLock );
+      uint32_t                      unused = bucket.leased.exchange( 0 );
+
+      if ( !unused ) {
+        return;
+      }
+
+      execute( STMT_LIMIT_RELEASE, bucket.configId, unused );
+    }
+
     bool AuthTokenDB::create_user( std::string user, std::string pass, std::string token ) {
       auto connection = dbPool.getConnection( );
       auto statement  = connection << "INSERT INTO users ( username, password, token )"
@@ -120,6 +603,24 @@ namespace token {
                                   << user << pass << token;
       auto rc = statement.executeUpdate( ) > 0;
       connection.commit( );
+
+      // Serving processes drop their cached credentials (e.g. a re-used API token cached against
+      // a previous owner) once their next refresh sees users' acl_versions bumped
+      return rc;
+    }
+
+    bool AuthTokenDB::set_password( std::string user, std::string pass ) {
+      auto connection = dbPool.getConnection( );
+      auto statement  = connection << "UPDATE users"
+                                     "   SET password = encode( digest( ?, 'sha256' ), 'hex' )"
+                                     " WHERE username = ? RETURNING id"
+                                  << pass << user;
+      bool rc = statement.executeQuery( ).next( );
+
+      connection.commit( );
+
+      // As with create_user( ), serving processes stop accepting the old password once their
+      // next refresh (auth.acl.refresh) sees the change
       return rc;
     }
 
@@ -156,72 +657,197 @@ namespace token {
       return rc;
     }
 
-    uint32_t AuthTokenDB::authorizedCreds( std::string user, std::string pass ) {
-      auto connection = dbPool.getConnection( );
-      auto statement  = connection << "SELECT id FROM users WHERE username = ? AND password = "
-                                     "encode( digest( ?, 'sha256' ), 'hex' )"
-                                  << user << pass;
-      auto rs = statement.executeQuery( );
-      return rs.next( ) ? rs.get< int32_t >( 0 ) : 0;
+    uint32_t AuthTokenDB::authorizedCreds( boost::string_view user, boost::string_view pass ) {
+      // Binding is the one place the credentials are copied
+      return execute( STMT_USER_CREDS,
+                      std::string( user.data( ), user.size( ) ),
+                      std::string( pass.data( ), pass.size( ) ) );
     }
 
-    uint32_t AuthTokenDB::authorizedToken( std::string token ) {
-      auto connection = dbPool.getConnection( );
-      auto statement  = connection << "SELECT id FROM users WHERE token = ?" << token;
-      auto rs         = statement.executeQuery( );
-      return rs.next( ) ? rs.get< int32_t >( 0 ) : 0;
+    bool AuthTokenDB::cached( const std::string &type,
+                              const std::string &credential,
+                              uint32_t &         uid ) const {
+      uid = 0;
+
+      if ( authCache && authCache->enabled( ) ) {
+        return authCache->find( AuthCache::fingerprint( type, credential ), uid );
+      }
+
+      return false;
     }
 
-    uint32_t AuthTokenDB::authorizedBasic( std::string encoded ) {
-      std::vector< char >    decoded;
-      std::shared_ptr< BIO > b64( BIO_new( BIO_f_base64( ) ),
-                                  []( BIO *bio ) { BIO_free_all( bio ); } );
+    /**
+     * @brief Identify who a credential cached as valid is, without consulting the database
+     * @param type lower case authorization scheme
+     * @param credential scheme credential
+     * @return user id, 0 unless cached as valid
+     */
+    uint32_t AuthTokenDB::known( const std::string &type, const std::string &credential ) const {
+      return authCache ? authCache->peek( AuthCache::fingerprint( type, credential ) ) : 0;
+    }
+
+    void AuthTokenDB::remember( const std::string &type,
+                                const std::string &credential,
+                                uint32_t           uid ) {
+      if ( authCache && authCache->enabled( ) ) {
+        authCache->insert( AuthCache::fingerprint( type, credential ), uid );
+      }
+    }
+
+    uint32_t AuthTokenDB::authorizedToken( std::string token ) {
+      uint32_t uid = 0;
 
-      decoded.resize( encoded.size( ) * 3 / 4 );
+      if ( !cached( "bearer", token, uid ) ) {
+        uid = execute( STMT_USER_TOKEN, token );
+        remember( "bearer", token, uid );
+      }
 
-      BIO_push(
-        b64.get( ),
-        BIO_new_mem_buf( reinterpret_cast< void * >( const_cast< char * >( encoded.c_str( ) ) ),
-                         encoded.size( ) ) );
-      BIO_set_flags( b64.get( ), BIO_FLAGS_BASE64_NO_NL );
+      return uid;
+    }
 
-      auto len = BIO_read( b64.get( ), &decoded[ 0 ], decoded.size( ) );
-      decoded.resize( len );
+    uint32_t AuthTokenDB::authorizedBasic( std::string encoded ) {
+      uint32_t uid = 0;
 
-      auto colon = std::find( decoded.begin( ), decoded.end( ), ':' );
+      if ( cached( "basic", encoded, uid ) ) {
+        return uid;
+      }
 
-      if ( colon == decoded.end( ) ) {
+      char                buffer[ basic_stack ];
+      std::vector< char > spill;
+      boost::string_view  user;
+      boost::string_view  pass;
+
+      if ( !basic_credentials( encoded, buffer, sizeof( buffer ), spill, user, pass ) ) {
         return 0;
       }
 
-      return authorizedCreds( std::string( &decoded[ 0 ], colon - decoded.begin( ) ),
-                              std::string( &*( colon + 1 ), decoded.end( ) - colon - 1 ) );
+      uid = authorizedCreds( user, pass );
+      remember( "basic", encoded, uid );
+
+      return uid;
     }
 
     bool AuthTokenDB::accessible( uint32_t uid, std::string vault ) {
-      auto connection = dbPool.getConnection( );
-      auto statement  = connection << "SELECT 1 FROM user_vaults WHERE userid = ? AND vault = ?"
-                                  << uid << vault;
-      auto rs = statement.executeQuery( );
-      return rs.next( ) ? rs.get< int32_t >( 0 ) : 0;
+      auto snapshot = acl.snapshot( );
+
+      if ( snapshot ) {
+        return snapshot->accessible( uid, vault );
+      }
+
+      return execute( STMT_USER_VAULT_ACCESS, uid, vault ) != 0;
     }
 
-    uint32_t AuthTokenDB::rate_limit( uint32_t user, std::string vault, uint32_t count ) {
-      uint32_t rc         = -1;
-      auto     connection = dbPool.getConnection( );
+    Authorization AuthTokenDB::authorize( uint32_t uid, const std::string &vault, uint32_t count ) {
+      Authorization result;
+
+      result.uid = uid;
 
       try {
-        auto statement = connection << "SELECT user_limit( ?::integer, ?, ?::integer )" << user
-                                    << vault << count;
-        auto rs = statement.executeQuery( );
+        result.access = accessible( uid, vault );
+      } catch ( std::exception &ex ) {
+        spdlog::error( "Unable to authorize request: {}", ex.what( ) );
+        result.access = false;
+        result.failed = true;
+        return result;
+      }
 
-        if ( rs.next( ) ) {
-          rc = rs.get< uint32_t >( 0 );
+      result.allowed = result.access ? rate_limit( uid, vault, count ) : 0;
+
+      return result;
+    }
+
+    Authorization AuthTokenDB::authorize( const std::string &type,
+                                          const std::string &credential,
+                                          const std::string &vault,
+                                          uint32_t           count ) {
+      Authorization result;
+      auto          snapshot = acl.snapshot( );
+
+      // Known bad credentials are turned away without any further work
+      if ( cached( type, credential, result.uid ) && !result.uid ) {
+        return result;
+      }
+
+      // Warm; everything can be answered from memory (or at most the rate limit query)
+      if ( result.uid && snapshot ) {
+        result.access  = snapshot->accessible( result.uid, vault );
+        result.allowed = result.access ? rate_limit( result.uid, vault, count ) : 0;
+        return result;
+      }
+
+      // Malformed Basic credentials can't match anyone; don't spend a round trip on them
+      if ( type == "basic" ) {
+        char                buffer[ basic_stack ];
+        std::vector< char > spill;
+        boost::string_view  user;
+        boost::string_view  pass;
+
+        if ( !basic_credentials( credential, buffer, sizeof( buffer ), spill, user, pass ) ) {
+          return Authorization{ };
         }
+      }
 
-        connection.commit( );
+      // Cold or disabled; one round trip for all three, unless the limits are held locally
+      bool local = localLimits && snapshot && limiter.snapshot( );
+
+      {
+        int32_t  uid     = 0;
+        int32_t  access  = 0;
+        uint32_t allowed = 0;
+
+        try {
+          query( STMT_AUTHORIZE,
+                 std::tie( uid, access, allowed ),
+                 type,
+                 credential,
+                 vault,
+                 local ? 0 : count );
+        } catch ( std::exception &ex ) {
+          spdlog::error( "Unable to authorize request: {}", ex.what( ) );
+
+          // Not a verdict on the credentials; neither cached nor counted against the client
+          result        = Authorization{ };
+          result.failed = true;
+          return result;
+        }
+
+        result.uid     = uid;
+        result.access  = access != 0;
+        result.allowed = allowed;
+      }
+
+      remember( type, credential, result.uid );
+
+      if ( local && result.access ) {
+        result.allowed = rate_limit( result.uid, vault, count );
+      }
+
+      return result;
+    }
+
+    uint32_t AuthTokenDB::rate_limit( uint32_t user, std::string vault, uint32_t count ) {
+      auto buckets  = limiter.snapshot( );
+      auto snapshot = acl.snapshot( );
+
+      if ( buckets && snapshot ) {
+        auto vid = snapshot->vaults->find( vault );
+
+        if ( vid != snapshot->vaults->end( ) ) {
+          auto bucket = buckets->find( RateLimiter::key( user, vid->second ) );
+
+          if ( bucket != buckets->end( ) ) {
+            return leaseSize ? lease( *bucket->second, count ) : bucket->second->acquire( count );
+          }
+        }
+
+        return count; // Unlimited, same as user_limit( ) without a configuration
+      }
+
+      uint32_t rc = -1;
+
+      try {
+        query( STMT_USER_LIMIT, std::tie( rc ), user, vault, count );
       } catch ( ... ) {
-        connection.rollback( );
       }
 
       return rc;
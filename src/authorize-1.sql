@@ -0,0 +1,58 @@
+
+CREATE OR REPLACE FUNCTION authorize_and_limit( _type       varchar,
+                                                _credential varchar,
+                                                _vault      varchar,
+                                                _requests   integer )
+  RETURNS TABLE ( uid integer, access boolean, allowed integer ) AS $$
+DECLARE
+  decoded varchar;
+  colon   integer;
+BEGIN
+  uid     := 0;
+  access  := false;
+  allowed := 0;
+
+  --
+  -- Authenticate
+  --
+  BEGIN
+    IF lower( _type ) = 'basic' THEN
+      decoded := convert_from( decode( _credential, 'base64' ), 'UTF8' );
+      colon   := position( ':' IN decoded );
+
+      IF colon > 0 THEN
+        SELECT u.id
+          INTO uid
+          FROM users u
+         WHERE u.username = substr( decoded, 1, colon - 1 )
+           AND u.password = encode( digest( substr( decoded, colon + 1 ), 'sha256' ), 'hex' );
+      END IF;
+    ELSIF lower( _type ) = 'bearer' THEN
+      SELECT u.id INTO uid FROM users u WHERE u.token = _credential;
+    END IF;
+  EXCEPTION WHEN others THEN -- Malformed credentials
+    uid := 0;
+  END;
+
+  uid := COALESCE( uid, 0 );
+
+  --
+  -- Authorize
+  --
+  IF uid <> 0 THEN
+    access := EXISTS ( SELECT 1
+                         FROM user_vaults uv
+                        INNER JOIN vaults v ON v.id = uv.vault
+                        WHERE uv.userid = uid
+                          AND _vault IN ( v.alias, v.tablename ) );
+  END IF;
+
+  --
+  -- Rate limit
+  --
+  IF access AND _requests > 0 THEN
+    allowed := user_limit( uid, _vault, _requests );
+  END IF;
+
+  RETURN NEXT;
+END $$ LANGUAGE plpgsql;
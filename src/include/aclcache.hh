@@ -0,0 +1,82 @@
+#ifndef __ACLCACHE_HH_
+#define __ACLCACHE_HH_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace token {
+  namespace app {
+
+    /**
+     * @brief Immutable copy of the user to vault access grants
+     */
+    struct AclSnapshot {
+      /** uid -> accessible vault ids */
+      using grant_map = std::unordered_map< uint32_t, std::unordered_set< int32_t > >;
+      /** vault alias, table name (or id) -> vault id */
+      using vault_map = std::unordered_map< std::string, int32_t >;
+
+      std::shared_ptr< const grant_map > grants;
+      std::shared_ptr< const vault_map > vaults;
+
+      /**
+       * @brief Identify if a user has been granted access to a vault
+       * @param uid user id
+       * @param vault vault alias, table name or id
+       * @return true if granted
+       */
+      bool accessible( uint32_t uid, const std::string &vault ) const {
+        auto vid = vaults->find( vault );
+
+        if ( vid == vaults->end( ) ) {
+          return false;
+        }
+
+        auto user = grants->find( uid );
+
+        return ( user != grants->end( ) ) && ( user->second.count( vid->second ) > 0 );
+      }
+    };
+
+    /**
+     * @brief Atomically published access control snapshot
+     *
+     * Readers take a reference to the current snapshot and never wait on a rebuild; the refresher
+     * builds a replacement off to the side and publishes it in one atomic store.
+     */
+    class AclCache {
+      std::shared_ptr< const AclSnapshot > current;
+
+     public:
+      /**
+       * @brief Get the current snapshot
+       * @return snapshot, or null if nothing has been loaded
+       */
+      std::shared_ptr< const AclSnapshot > snapshot( ) const {
+        return std::atomic_load( &current );
+      }
+
+      /**
+       * @brief Replace the current snapshot
+       * @param grants user grants, or null to keep the current grants
+       * @param vaults vault names, or null to keep the current names
+       * @note the first publication must supply both
+       */
+      void publish( std::shared_ptr< const AclSnapshot::grant_map > grants,
+                    std::shared_ptr< const AclSnapshot::vault_map > vaults ) {
+        auto prior = snapshot( );
+        auto next  = std::make_shared< AclSnapshot >( );
+
+        next->grants = grants ? std::move( grants ) : prior->grants;
+        next->vaults = vaults ? std::move( vaults ) : prior->vaults;
+
+        std::atomic_store( &current, std::shared_ptr< const AclSnapshot >( std::move( next ) ) );
+      }
+    };
+  } // namespace app
+} // namespace token
+
+#endif // __ACLCACHE_HH_
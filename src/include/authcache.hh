@@ -0,0 +1,244 @@
+#ifndef __AUTHCACHE_HH_
+#define __AUTHCACHE_HH_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <openssl/evp.h>
+#include <prometheus/counter.h>
+#include <prometheus/registry.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace token {
+  namespace app {
+
+    /**
+     * @brief Bounded, sharded, time limited credential to user id cache
+     *
+     * Keys are credential fingerprints (see fingerprint()), so the raw credential never lives in
+     * memory longer than the request that carried it.  Each shard is an independent LRU guarded
+     * by its own lock.
+     *
+     * Rejected credentials are cached too (as user id 0), on their own, shorter, lifetime; so a
+     * client repeating bad credentials doesn't cost a database query each time.
+     */
+    class AuthCache {
+     public:
+      using clock_type    = std::chrono::steady_clock;
+      using time_type     = clock_type::time_point;
+      using duration_type = std::chrono::seconds;
+      using counter_type  = prometheus::Counter;
+
+     private:
+      struct entry_type {
+        std::string key;    /**< Credential fingerprint */
+        uint32_t    uid;    /**< Authorized user id     */
+        time_type   expire; /**< Entry expiration       */
+      };
+
+      using list_type = std::list< entry_type >;
+      using map_type  = std::unordered_map< std::string, list_type::iterator >;
+
+      struct shard_type {
+        std::mutex lock;
+        list_type  lru; /**< Most recently used at the front */
+        map_type   map;
+      };
+
+      std::vector< std::unique_ptr< shard_type > > shards;
+      size_t                                       shardCapacity;
+      duration_type                                ttl;
+      duration_type                                negativeTtl;
+      counter_type *                               hits       = nullptr;
+      counter_type *                               misses     = nullptr;
+      counter_type *                               evictions  = nullptr;
+      counter_type *                               rejections = nullptr;
+
+      shard_type &shard( const std::string &key ) {
+        return *shards[ std::hash< std::string >( )( key ) % shards.size( ) ];
+      }
+
+      static void count( counter_type *counter ) {
+        if ( counter ) {
+          counter->Increment( );
+        }
+      }
+
+     public:
+      /**
+       * @brief Create the cache
+       * @param capacity maximum number of cached credentials (across all shards)
+       * @param _ttl entry lifetime; zero disables caching
+       * @param count number of independently locked shards
+       * @param _negativeTtl rejected credential lifetime; zero disables negative caching
+       */
+      AuthCache( size_t        capacity,
+                 duration_type _ttl,
+                 size_t        count,
+                 duration_type _negativeTtl = duration_type( 0 ) )
+        : shardCapacity( 1 )
+        , ttl( _ttl )
+        , negativeTtl( _negativeTtl ) {
+        if ( count < 1 ) {
+          count = 1;
+        }
+
+        shardCapacity = std::max< size_t >( 1, capacity / count );
+
+        for ( size_t num = 0; num < count; ++num ) {
+          shards.emplace_back( new shard_type );
+        }
+      }
+
+      /**
+       * @brief Identify if caching is active
+       * @return true if entries are retained
+       */
+      bool enabled( ) const { return ( ttl.count( ) > 0 ) || ( negativeTtl.count( ) > 0 ); }
+
+      /**
+       * @brief Register the cache hit/miss/eviction/rejection counters
+       * @param registry metric registry
+       */
+      void metrics( prometheus::Registry &registry ) {
+        auto &family = prometheus::BuildCounter( )
+                         .Name( "auth_cache" )
+                         .Help( "Authentication cache lookups and evictions" )
+                         .Register( registry );
+
+        hits       = &family.Add( { { "result", "hit" } } );
+        misses     = &family.Add( { { "result", "miss" } } );
+        evictions  = &family.Add( { { "result", "eviction" } } );
+        rejections = &family.Add( { { "result", "rejected" } } );
+      }
+
+      /**
+       * @brief Generate the cache key for a credential
+       * @param type credential type (basic, bearer)
+       * @param credential credential as supplied by the client
+       * @return SHA-256 digest of the type and credential
+       */
+      static std::string fingerprint( const std::string &type, const std::string &credential ) {
+        EVP_MD_CTX * ctx = EVP_MD_CTX_create( );
+        uint8_t      digest[ EVP_MAX_MD_SIZE ];
+        unsigned int length = 0;
+
+        EVP_DigestInit_ex( ctx, EVP_sha256( ), nullptr );
+        EVP_DigestUpdate( ctx, type.data( ), type.size( ) );
+        EVP_DigestUpdate( ctx, ":", 1 );
+        EVP_DigestUpdate( ctx, credential.data( ), credential.size( ) );
+        EVP_DigestFinal_ex( ctx, digest, &length );
+        EVP_MD_CTX_destroy( ctx );
+
+        return std::string( reinterpret_cast< char * >( digest ), length );
+      }
+
+      /**
+       * @brief Look up a credential fingerprint
+       * @param key credential fingerprint
+       * @param uid [out] cached user id, 0 for a cached rejection
+       * @return true on a (non-expired) hit
+       */
+      bool find( const std::string &key, uint32_t &uid ) {
+        if ( !enabled( ) ) {
+          return false;
+        }
+
+        auto &                        s = shard( key );
+        std::lock_guard< std::mutex > guard( s.lock );
+        auto                          it = s.map.find( key );
+
+        if ( it == s.map.end( ) ) {
+          count( misses );
+          return false;
+        }
+
+        if ( it->second->expire < clock_type::now( ) ) {
+          s.lru.erase( it->second );
+          s.map.erase( it );
+          count( misses );
+          return false;
+        }
+
+        s.lru.splice( s.lru.begin( ), s.lru, it->second );
+        uid = it->second->uid;
+        count( uid ? hits : rejections );
+        return true;
+      }
+
+      /**
+       * @brief Look up a credential fingerprint, for a hint; uncounted, and leaves the LRU as is
+       * @param key credential fingerprint
+       * @return cached user id, 0 for a miss or a cached rejection
+       */
+      uint32_t peek( const std::string &key ) {
+        if ( !enabled( ) ) {
+          return 0;
+        }
+
+        auto &                        s = shard( key );
+        std::lock_guard< std::mutex > guard( s.lock );
+        auto                          it = s.map.find( key );
+
+        if ( ( it == s.map.end( ) ) || ( it->second->expire < clock_type::now( ) ) ) {
+          return 0;
+        }
+
+        return it->second->uid;
+      }
+
+      /**
+       * @brief Record an authentication result
+       * @param key credential fingerprint
+       * @param uid authorized user id, 0 if the credential was rejected
+       */
+      void insert( const std::string &key, uint32_t uid ) {
+        auto lifetime = uid ? ttl : negativeTtl;
+
+        if ( lifetime.count( ) <= 0 ) {
+          return;
+        }
+
+        auto &                        s = shard( key );
+        std::lock_guard< std::mutex > guard( s.lock );
+        auto                          it     = s.map.find( key );
+        auto                          expire = clock_type::now( ) + lifetime;
+
+        if ( it != s.map.end( ) ) {
+          it->second->uid    = uid;
+          it->second->expire = expire;
+          s.lru.splice( s.lru.begin( ), s.lru, it->second );
+          return;
+        }
+
+        while ( s.map.size( ) >= shardCapacity ) {
+          s.map.erase( s.lru.back( ).key );
+          s.lru.pop_back( );
+          count( evictions );
+        }
+
+        s.lru.push_front( entry_type{ key, uid, expire } );
+        s.map[ key ] = s.lru.begin( );
+      }
+
+      /**
+       * @brief Drop every cached credential
+       */
+      void clear( ) {
+        for ( auto &s : shards ) {
+          std::lock_guard< std::mutex > guard( s->lock );
+          s->map.clear( );
+          s->lru.clear( );
+        }
+      }
+    };
+  } // namespace app
+} // namespace token
+
+#endif // __AUTHCACHE_HH_
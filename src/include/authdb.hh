@@ -1,12 +1,85 @@
 #ifndef __AUTHDB_H_
 #define __AUTHDB_H_
 
+#include "aclcache.hh"
+#include "authcache.hh"
+#include "ratelimit.hh"
+#include <atomic>
+#include <boost/utility/string_view.hpp>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <prometheus/counter.h>
+#include <prometheus/registry.h>
+#include <thread>
 #include <token/api/core/database.hh>
+#include <tuple>
 
 namespace token {
   namespace app {
+    /**
+     * @brief Outcome of authenticating, authorizing and rate limiting a request
+     */
+    struct Authorization {
+      uint32_t uid     = 0;     /**< Authenticated user id, 0 if not authenticated */
+      bool     access  = false; /**< User may access the vault                      */
+      uint32_t allowed = 0;     /**< Number of requests allowed by the rate limit   */
+      bool     failed  = false; /**< The database couldn't be asked; nothing decided */
+    };
+
     class AuthTokenDB : public token::api::core::TokenDB {
+      /** Credential to user id cache; null when disabled */
+      std::shared_ptr< AuthCache > authCache;
+      /** Bumped whenever users (and so their credentials) change */
+      std::atomic< uint64_t > userGeneration{ 0 };
+
+      /** In-memory access grants; consulted once the refresher has loaded it */
+      AclCache                                   acl;
+      std::thread                                aclThread;
+      std::mutex                                 aclLock;
+      std::condition_variable                    aclCond;
+      bool                                       aclDone = false;
+      std::unordered_map< std::string, int64_t > aclVersions;
+      /** In-memory rate limits; consulted once the refresher has loaded them */
+      RateLimiter               limiter;
+      bool                      localLimits = false;
+      uint32_t                  leaseSize   = 0;
+      std::chrono::milliseconds leaseTtl{ 0 };
+
+      /** Hot path statements; server functions, so their plans are cached per connection */
+      enum statement_id {
+        STMT_USER_CREDS,
+        STMT_USER_TOKEN,
+        STMT_USER_VAULT_ACCESS,
+        STMT_AUTHORIZE,
+        STMT_USER_LIMIT,
+        STMT_LIMIT_LEASE,
+        STMT_LIMIT_RELEASE,
+        STMT_COUNT
+      };
+
+      prometheus::Counter *stmtInstalled = nullptr;
+      prometheus::Counter *stmtExecuted  = nullptr;
+
+      template < typename Connection >
+      void install( Connection &connection );
+      template < typename... Columns, typename... Args >
+      bool query( statement_id id, std::tuple< Columns &... > row, const Args &... args );
+      template < typename... Args >
+      int32_t execute( statement_id id, const Args &... args );
+
+      bool     cached( const std::string &type,
+                       const std::string &credential,
+                       uint32_t &         uid ) const;
+      void     remember( const std::string &type, const std::string &credential, uint32_t uid );
+      void     acl_refresh( );
+      void     limits_load( );
+      void     limits_flush( );
+      uint32_t lease( LimitBucket &bucket, uint32_t count );
+      void     lease_release( LimitBucket &bucket );
+
      public:
       AuthTokenDB( Uri *uri, size_t cxnCount )
         : TokenDB( uri, cxnCount ) {
@@ -16,17 +89,30 @@ namespace token {
         : TokenDB( uri, cxnCount ) {
         init( );
       }
+      virtual ~AuthTokenDB( );
 
       void         init( );
-      uint32_t     authorizedCreds( std::string user, std::string pass );
+      uint32_t     authorizedCreds( boost::string_view user, boost::string_view pass );
       uint32_t     authorizedToken( std::string token );
       uint32_t     authorizedBasic( std::string encoded );
       bool         accessible( uint32_t uid, std::string vault );
+      Authorization authorize( const std::string &type,
+                               const std::string &credential,
+                               const std::string &vault,
+                               uint32_t           count );
+      Authorization authorize( uint32_t uid, const std::string &vault, uint32_t count );
+      uint32_t     known( const std::string &type, const std::string &credential ) const;
+      uint64_t     generation( ) const { return userGeneration.load( std::memory_order_acquire ); }
       uint32_t     rate_limit( uint32_t user, std::string vault, uint32_t count );
       virtual bool createVault( const token::api::core::VaultInfo &vault ) override;
       bool         create_user( std::string user, std::string password, std::string token );
+      bool         set_password( std::string user, std::string password );
       bool         grant_user( std::string user, std::string vault );
       bool         limit_user( std::string user, std::string vault, int count, std::string period );
+      void         cache( std::shared_ptr< AuthCache > _cache ) { authCache = std::move( _cache ); }
+      void         metrics( prometheus::Registry &registry );
+      void         acl_start( std::chrono::milliseconds interval, bool local_limits );
+      void         lease_start( uint32_t size, std::chrono::milliseconds ttl );
     };
   } // namespace app
 } // namespace token
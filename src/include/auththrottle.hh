@@ -0,0 +1,205 @@
+#ifndef __AUTHTHROTTLE_HH_
+#define __AUTHTHROTTLE_HH_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <prometheus/counter.h>
+#include <prometheus/registry.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace token {
+  namespace app {
+
+    /**
+     * @brief Failed authentication tracking, per remote address
+     *
+     * Counts failures over a fixed window; an address exceeding the limit is turned away, with
+     * no credential checking at all, until its block expires.  Tracking is bounded; when a shard
+     * is full of live entries, new addresses simply go untracked.  A full shard is swept for
+     * expired entries at most once a second, so a flood of new addresses doesn't rescan it on
+     * every failure.
+     */
+    class AuthThrottle {
+     public:
+      using clock_type    = std::chrono::steady_clock;
+      using time_type     = clock_type::time_point;
+      using duration_type = std::chrono::seconds;
+      using counter_type  = prometheus::Counter;
+
+     private:
+      struct entry_type {
+        uint32_t  failures = 0; /**< Failures in the current window */
+        time_type window;       /**< Current window expiration       */
+        time_type blocked;      /**< Turned away until               */
+      };
+
+      struct shard_type {
+        std::mutex                                    lock;
+        std::unordered_map< std::string, entry_type > map;
+        time_type                                     swept; /**< Next sweep allowed */
+      };
+
+      std::vector< std::unique_ptr< shard_type > > shards;
+      size_t                                       shardCapacity;
+      uint32_t                                     limit;
+      duration_type                                window;
+      duration_type                                block;
+      counter_type *                               failures  = nullptr;
+      counter_type *                               blocks    = nullptr;
+      counter_type *                               rejected  = nullptr;
+      counter_type *                               untracked = nullptr;
+
+      shard_type &shard( const std::string &address ) {
+        return *shards[ std::hash< std::string >( )( address ) % shards.size( ) ];
+      }
+
+      static void count( counter_type *counter ) {
+        if ( counter ) {
+          counter->Increment( );
+        }
+      }
+
+      /** Drop entries with neither a live window nor a live block */
+      static void sweep( shard_type &s, time_type now ) {
+        for ( auto it = s.map.begin( ); it != s.map.end( ); ) {
+          if ( ( it->second.window < now ) && ( it->second.blocked < now ) ) {
+            it = s.map.erase( it );
+          } else {
+            ++it;
+          }
+        }
+      }
+
+     public:
+      /**
+       * @brief Create the throttle
+       * @param _limit failures allowed per window; zero disables throttling
+       * @param _window failure counting window
+       * @param _block how long an address is turned away once over the limit
+       * @param capacity maximum number of tracked addresses (across all shards)
+       * @param count number of independently locked shards
+       */
+      AuthThrottle( uint32_t      _limit,
+                    duration_type _window,
+                    duration_type _block,
+                    size_t        capacity,
+                    size_t        count )
+        : shardCapacity( 1 )
+        , limit( _limit )
+        , window( _window )
+        , block( _block ) {
+        if ( count < 1 ) {
+          count = 1;
+        }
+
+        shardCapacity = std::max< size_t >( 1, capacity / count );
+
+        for ( size_t num = 0; num < count; ++num ) {
+          shards.emplace_back( new shard_type );
+        }
+      }
+
+      /**
+       * @brief Identify if throttling is active
+       * @return true if failures are tracked
+       */
+      bool enabled( ) const { return limit > 0; }
+
+      /**
+       * @brief Get how long a blocked address is turned away for
+       * @return block duration
+       */
+      duration_type duration( ) const { return block; }
+
+      /**
+       * @brief Register the failure/block/rejection counters
+       * @param registry metric registry
+       */
+      void metrics( prometheus::Registry &registry ) {
+        auto &family = prometheus::BuildCounter( )
+                         .Name( "auth_throttle" )
+                         .Help( "Failed authentications and the addresses turned away for them" )
+                         .Register( registry );
+
+        failures  = &family.Add( { { "result", "failure" } } );
+        blocks    = &family.Add( { { "result", "blocked" } } );
+        rejected  = &family.Add( { { "result", "rejected" } } );
+        untracked = &family.Add( { { "result", "untracked" } } );
+      }
+
+      /**
+       * @brief Identify if an address is being turned away
+       * @param address remote host
+       * @return true if blocked
+       */
+      bool blocked( const std::string &address ) {
+        if ( !enabled( ) ) {
+          return false;
+        }
+
+        auto &                        s = shard( address );
+        std::lock_guard< std::mutex > guard( s.lock );
+        auto                          it = s.map.find( address );
+
+        if ( ( it == s.map.end( ) ) || ( it->second.blocked < clock_type::now( ) ) ) {
+          return false;
+        }
+
+        count( rejected );
+        return true;
+      }
+
+      /**
+       * @brief Record a failed authentication
+       * @param address remote host
+       */
+      void failure( const std::string &address ) {
+        if ( !enabled( ) ) {
+          return;
+        }
+
+        auto &                        s = shard( address );
+        std::lock_guard< std::mutex > guard( s.lock );
+        auto                          now = clock_type::now( );
+        auto                          it  = s.map.find( address );
+
+        count( failures );
+
+        if ( it == s.map.end( ) ) {
+          if ( ( s.map.size( ) >= shardCapacity ) && ( s.swept < now ) ) {
+            sweep( s, now );
+            s.swept = now + std::chrono::seconds( 1 );
+          }
+
+          if ( s.map.size( ) >= shardCapacity ) {
+            count( untracked );
+            return;
+          }
+
+          it = s.map.emplace( address, entry_type{ } ).first;
+        }
+
+        auto &entry = it->second;
+
+        if ( entry.window < now ) {
+          entry.failures = 0;
+          entry.window   = now + window;
+        }
+
+        if ( ++entry.failures > limit ) {
+          entry.blocked  = now + block;
+          entry.failures = 0;
+          count( blocks );
+        }
+      }
+    };
+  } // namespace app
+} // namespace token
+
+#endif // __AUTHTHROTTLE_HH_
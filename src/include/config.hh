@@ -5,6 +5,7 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <map>
 #include <spdlog/spdlog.h>
 
 namespace token {
@@ -14,12 +15,58 @@ namespace token {
 #define DATABASE_POOL_SIZE_DEFAULT 1
     /** Default worker thread count */
 #define WORKER_POOL_SIZE_DEFAULT std::thread::hardware_concurrency( )
+    /** Default maximum number of queued requests */
+#define WORKER_QUEUE_DEPTH_DEFAULT 10000
+    /** Default maximum time a request may wait in the queue (milliseconds) */
+#define WORKER_QUEUE_WAIT_DEFAULT 5000
+    /** Default adaptive limiting of how many requests are handled at once */
+#define WORKER_LIMIT_ADAPTIVE_DEFAULT false
+    /** Default lowest adaptive limit of requests handled at once */
+#define WORKER_LIMIT_MIN_DEFAULT 1
+    /** Default highest adaptive limit of requests handled at once; 0 for the pool size */
+#define WORKER_LIMIT_MAX_DEFAULT 0
+    /** Default worker thread count of a vault with its own pool */
+#define VAULT_POOL_SIZE_DEFAULT 2
     /** Default HTTP/REST IO thread count */
 #define HTTP_POOL_SIZE_DEFAULT 1
+    /** Default HTTP/REST IO threading; one io service shared by all threads (false) */
+#define HTTP_PER_THREAD_DEFAULT false
+    /** Default HTTP/REST IO thread core pinning */
+#define HTTP_PIN_DEFAULT false
+    /** Default HTTP/REST requests handled at once per connection (pipelining) */
+#define HTTP_PIPELINE_DEFAULT 4
+    /** Default HTTP/REST requests in flight at once per HTTP/2 connection; HTTP/2 is opt-in */
+#define HTTP_STREAMS_DEFAULT 0
+    /** Default HTTP/REST JSON responses; compact (false) or indented */
+#define HTTP_PRETTY_DEFAULT false
     /** Default HTTP/REST address */
 #define HTTP_REST_ADDRESS_DEFAULT "::"
     /** Default HTTP/REST port */
 #define HTTP_REST_PORT_DEFAULT 8080
+    /** Default authentication cache entry lifetime (seconds) */
+#define AUTH_CACHE_TTL_DEFAULT 30
+    /** Default authentication cache capacity */
+#define AUTH_CACHE_SIZE_DEFAULT 10000
+    /** Default authentication cache shard count */
+#define AUTH_CACHE_SHARDS_DEFAULT 16
+    /** Default rejected credential cache lifetime (seconds) */
+#define AUTH_CACHE_NEGATIVE_TTL_DEFAULT 5
+    /** Default lifetime of a credential validated on a keep-alive connection (seconds) */
+#define AUTH_SESSION_TTL_DEFAULT 60
+    /** Default failed authentications allowed from one address per window; off */
+#define AUTH_FAILURE_LIMIT_DEFAULT 0
+    /** Default failed authentication counting window (seconds) */
+#define AUTH_FAILURE_WINDOW_DEFAULT 60
+    /** Default time an address is turned away once over the limit (seconds) */
+#define AUTH_FAILURE_BLOCK_DEFAULT 60
+    /** Default vault access snapshot refresh interval (milliseconds) */
+#define AUTH_ACL_REFRESH_DEFAULT 1000
+    /** Default rate limit enforcement; by the database until an operator opts in */
+#define RATELIMIT_LOCAL_DEFAULT false
+    /** Default rate limit lease size; 0 keeps the whole allowance on this node */
+#define RATELIMIT_LEASE_SIZE_DEFAULT 0
+    /** Default rate limit lease lifetime (milliseconds) */
+#define RATELIMIT_LEASE_TTL_DEFAULT 1000
 
     /**
      * @brief Application configuration class wrapper
@@ -90,6 +137,47 @@ namespace token {
         return config.get( "http.rest.pool_size", HTTP_POOL_SIZE_DEFAULT );
       }
 
+      /**
+       * @brief Identify if each HTTP/REST IO thread has its own io service and listener, with
+       *        connections spread between them by the kernel
+       * @return true if per thread, false if shared
+       */
+      bool restPerThread( ) const {
+        return config.get( "http.rest.per_thread", HTTP_PER_THREAD_DEFAULT );
+      }
+
+      /**
+       * @brief Identify if per thread HTTP/REST IO threads are pinned to cores
+       * @return true if pinned
+       */
+      bool restPin( ) const { return config.get( "http.rest.pin", HTTP_PIN_DEFAULT ); }
+
+      /**
+       * @brief Get how many pipelined requests are handled at once per connection; responses are
+       *        still sent in request order
+       * @return configured depth, 1 handles requests one at a time
+       */
+      int restPipeline( ) const {
+        return config.get( "http.rest.pipeline", HTTP_PIPELINE_DEFAULT );
+      }
+
+      /**
+       * @brief Get how many requests an HTTP/2 connection may have in flight at once; HTTP/2 is
+       *        offered by ALPN over TLS, or taken with prior knowledge (h2c) otherwise
+       *
+       * Off unless set; once set, every plain text connection is sniffed for the h2c preface.
+       *
+       * @return configured streams, 0 for HTTP/1.1 only
+       */
+      int restStreams( ) const { return config.get( "http.rest.streams", HTTP_STREAMS_DEFAULT ); }
+
+      /**
+       * @brief Get if JSON responses are indented for reading, rather than compact; streamed
+       *        batch responses are always compact
+       * @return true if indented
+       */
+      bool restPretty( ) const { return config.get( "http.rest.pretty", HTTP_PRETTY_DEFAULT ); }
+
       /**
        * @brief Get the number of worker threads
        * @return configured pool size or CPU core count if unconfigured
@@ -98,6 +186,210 @@ namespace token {
         return config.get( "worker.pool_size", WORKER_POOL_SIZE_DEFAULT );
       }
 
+      /**
+       * @brief Get the maximum number of requests queued for the workers
+       * @return configured depth, 0 for no limit
+       */
+      int workerQueueDepth( ) const {
+        return config.get( "worker.queue.depth", WORKER_QUEUE_DEPTH_DEFAULT );
+      }
+
+      /**
+       * @brief Get the maximum time a request may wait for a worker
+       * @return configured wait in milliseconds, 0 for no limit
+       */
+      int workerQueueWait( ) const {
+        return config.get( "worker.queue.wait", WORKER_QUEUE_WAIT_DEFAULT );
+      }
+
+      /**
+       * @brief Identify if the number of requests handled at once should adapt to their latency,
+       *        from the worker count up to worker.limit.max; latency rising with concurrency
+       *        lowers the limit
+       *
+       * Requests are still served by database.pool_size connections; past that they wait for a
+       * connection, which the limit sees as latency and backs off from, so the database pool
+       * remains the bound to tune for database bound work.
+       *
+       * @return true if adaptive
+       */
+      bool workerLimitAdaptive( ) const {
+        return config.get( "worker.limit.adaptive", WORKER_LIMIT_ADAPTIVE_DEFAULT );
+      }
+
+      /**
+       * @brief Get the lowest adaptive limit of requests handled at once
+       * @return configured minimum
+       */
+      int workerLimitMin( ) const {
+        return config.get( "worker.limit.min", WORKER_LIMIT_MIN_DEFAULT );
+      }
+
+      /**
+       * @brief Get the highest adaptive limit of requests handled at once, per pool; each pool
+       *        runs this many workers, the limit starting from the pool's configured size
+       * @return configured maximum, 0 (or less than a pool's size) for the pool's size
+       */
+      int workerLimitMax( ) const {
+        return config.get( "worker.limit.max", WORKER_LIMIT_MAX_DEFAULT );
+      }
+
+      /**
+       * @brief Get the users' shares of the workers, from the [weights] section; e.g. "7 = 4"
+       *        serves up to 4 of user 7's requests for each of another (unweighted) user's
+       * @return weights by user id
+       */
+      std::map< uint32_t, unsigned > workerWeights( ) const {
+        std::map< uint32_t, unsigned > weights;
+
+        if ( auto section = config.get_child_optional( "weights" ) ) {
+          for ( auto &entry : *section ) {
+            weights[ std::stoul( entry.first ) ] = entry.second.get_value< unsigned >( );
+          }
+        }
+
+        return weights;
+      }
+
+      /**
+       * @brief Get the vaults with workers of their own; the pool_size of [vault.<name>] sections
+       *
+       * A vault's requests are handled by its own workers, so a slow vault only delays itself;
+       * as each worker holds at most one database connection at a time, the pool size also caps
+       * the database connections the vault can tie up.  Other vaults share the worker pool.
+       *
+       * @return worker thread count by vault name
+       */
+      std::map< std::string, int > vaultPoolSizes( ) const {
+        static const std::string prefix = "vault.";
+
+        std::map< std::string, int > sizes;
+
+        for ( auto &section : config ) {
+          if ( ( section.first.size( ) > prefix.size( ) ) &&
+               ( section.first.compare( 0, prefix.size( ), prefix ) == 0 ) ) {
+            sizes[ section.first.substr( prefix.size( ) ) ] =
+              section.second.get( "pool_size", VAULT_POOL_SIZE_DEFAULT );
+          }
+        }
+
+        return sizes;
+      }
+
+      /**
+       * @brief Get the authentication cache entry lifetime
+       *
+       * Changed users (e.g. a new password) are noticed by the access snapshot refresh, which
+       * drops the cache; so an old credential is accepted for up to auth.acl.refresh, or for up
+       * to this lifetime if the refresh is disabled.
+       *
+       * @return configured lifetime in seconds, 0 disables the cache
+       */
+      int authCacheTtl( ) const { return config.get( "auth.cache.ttl", AUTH_CACHE_TTL_DEFAULT ); }
+
+      /**
+       * @brief Get the maximum number of cached credentials
+       * @return configured cache capacity
+       */
+      int authCacheSize( ) const {
+        return config.get( "auth.cache.size", AUTH_CACHE_SIZE_DEFAULT );
+      }
+
+      /**
+       * @brief Get the number of authentication cache shards
+       * @return configured shard count
+       */
+      int authCacheShards( ) const {
+        return config.get( "auth.cache.shards", AUTH_CACHE_SHARDS_DEFAULT );
+      }
+
+      /**
+       * @brief Get the rejected credential cache lifetime
+       * @return configured lifetime in seconds, 0 disables caching rejections
+       */
+      int authCacheNegativeTtl( ) const {
+        return config.get( "auth.cache.negative_ttl", AUTH_CACHE_NEGATIVE_TTL_DEFAULT );
+      }
+
+      /**
+       * @brief Get how long a credential validated on a connection is trusted for that connection
+       * @return configured lifetime in seconds, 0 validates every request
+       */
+      int authSessionTtl( ) const {
+        return config.get( "auth.session.ttl", AUTH_SESSION_TTL_DEFAULT );
+      }
+
+      /**
+       * @brief Get the number of failed authentications allowed from one address per window
+       *
+       * Off by default. Failures are counted per peer address, so behind a proxy, gateway or
+       * load balancer every client shares one address and a few bad credentials turn all of
+       * them away; only enable it when peers are the clients themselves.
+       *
+       * @return configured failure limit, 0 disables failure throttling
+       */
+      int authFailureLimit( ) const {
+        return config.get( "auth.failure.limit", AUTH_FAILURE_LIMIT_DEFAULT );
+      }
+
+      /**
+       * @brief Get the window failed authentications are counted over
+       * @return configured window in seconds
+       */
+      int authFailureWindow( ) const {
+        return config.get( "auth.failure.window", AUTH_FAILURE_WINDOW_DEFAULT );
+      }
+
+      /**
+       * @brief Get how long an address is turned away once over the failure limit
+       * @return configured duration in seconds
+       */
+      int authFailureBlock( ) const {
+        return config.get( "auth.failure.block", AUTH_FAILURE_BLOCK_DEFAULT );
+      }
+
+      /**
+       * @brief Get the vault access snapshot refresh interval
+       * @return configured interval in milliseconds, 0 queries the database on every request
+       */
+      int authAclRefresh( ) const {
+        return config.get( "auth.acl.refresh", AUTH_ACL_REFRESH_DEFAULT );
+      }
+
+      /**
+       * @brief Identify if rate limits are enforced in process
+       *
+       * Off by default. Without a lease size each node holds a user's whole allowance, which
+       * is only correct for a single node; N replicas on one database admit up to N times the
+       * limit. Set ratelimit.lease_size as well when running more than one.
+       *
+       * @return true for in-process limits (written back each refresh interval), false to call
+       *         the database on every request
+       */
+      bool rateLimitLocal( ) const {
+        return config.get( "ratelimit.local", RATELIMIT_LOCAL_DEFAULT );
+      }
+
+      /**
+       * @brief Get the number of requests reserved from the database at a time
+       *
+       * Required when several nodes share a database; each node may overshoot a limit by at
+       * most this many requests.
+       *
+       * @return configured lease size, 0 if unconfigured (single node)
+       */
+      int rateLimitLeaseSize( ) const {
+        return config.get( "ratelimit.lease_size", RATELIMIT_LEASE_SIZE_DEFAULT );
+      }
+
+      /**
+       * @brief Get how long an unspent lease is held before being returned
+       * @return configured lifetime in milliseconds
+       */
+      int rateLimitLeaseTtl( ) const {
+        return config.get( "ratelimit.lease_ttl", RATELIMIT_LEASE_TTL_DEFAULT );
+      }
+
       /**
        * @brief Get the configured log level
        * @return configured log level, defaults to 'info' level
@@ -0,0 +1,172 @@
+#ifndef __JSONSPLIT_HH_
+#define __JSONSPLIT_HH_
+
+#include <boost/utility/string_view.hpp>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace token {
+  namespace app {
+
+    /**
+     * @brief Incremental splitting of a JSON document into its top level array elements
+     *
+     * Fed the document a piece at a time, each element's text is handed on as soon as it is
+     * complete, without the rest of the document ever being held; only framing is checked here,
+     * the elements themselves are left to be parsed.  A document that is not an array is handed
+     * on whole, as one element, once finished.  Elements (or a whole document) longer than the
+     * limit are an error.
+     */
+    class JsonSplit {
+      enum class state_type : uint8_t {
+        start,   /**< Before the document        */
+        next,    /**< Before an element or ']'   */
+        element, /**< Within an element          */
+        after,   /**< After an element           */
+        single,  /**< Within a non-array document */
+        end,     /**< After the array            */
+        failed   /**< Malformed or too long      */
+      };
+
+      std::string text;                       /**< Element so far */
+      size_t      limit;                      /**< Element length limit */
+      size_t      count   = 0;                /**< Elements split */
+      size_t      depth   = 0;                /**< Nesting within the element */
+      bool        quoted  = false;            /**< Within a string */
+      bool        escaped = false;            /**< After a '\' within a string */
+      bool        listed  = false;            /**< The document is an array */
+      state_type  state   = state_type::start;
+
+     public:
+      /**
+       * @brief Constructor
+       * @param _limit element length limit
+       */
+      explicit JsonSplit( size_t _limit )
+        : limit( _limit ) {}
+
+      /**
+       * @brief Identify if the document is an array (known once it has started)
+       * @return true if an array
+       */
+      bool array( ) const {
+        return listed;
+      }
+
+      /**
+       * @brief Split the next piece of the document
+       * @param data document piece
+       * @param element called with the text of each complete array element
+       * @return false if the document is malformed, or an element too long
+       */
+      template < typename Function >
+      bool write( boost::string_view data, Function element ) {
+        for ( auto ch : data ) {
+          switch ( state ) {
+            case state_type::start:
+              if ( ch == '[' ) {
+                state  = state_type::next;
+                listed = true;
+              } else if ( !std::isspace( static_cast< unsigned char >( ch ) ) ) {
+                state = state_type::single;
+                text.push_back( ch );
+              }
+              break;
+
+            case state_type::next:
+            case state_type::element:
+              if ( scan( ch ) ) {
+                break;
+              } else if ( std::isspace( static_cast< unsigned char >( ch ) ) ) {
+                state = ( state == state_type::element ) ? state_type::after : state;
+                break;
+              } else if ( ( ch == ']' ) && ( state == state_type::next ) && !count ) {
+                state = state_type::end; // Empty array
+                break;
+              } else if ( state == state_type::next ) {
+                state = state_type::failed;
+                break;
+              }
+              // Falls through - the element is complete
+
+            case state_type::after:
+              if ( ch == ',' || ch == ']' ) {
+                element( text );
+                text.clear( );
+                ++count;
+                state = ( ch == ',' ) ? state_type::next : state_type::end;
+              } else if ( !std::isspace( static_cast< unsigned char >( ch ) ) ) {
+                state = state_type::failed;
+              }
+              break;
+
+            case state_type::single:
+              text.push_back( ch );
+              break;
+
+            case state_type::end:
+              if ( !std::isspace( static_cast< unsigned char >( ch ) ) ) {
+                state = state_type::failed;
+              }
+              break;
+
+            case state_type::failed:
+              return false;
+          }
+
+          if ( text.size( ) > limit ) {
+            state = state_type::failed;
+          }
+        }
+
+        return state != state_type::failed;
+      }
+
+      /**
+       * @brief Complete the document
+       * @param element called with the text of the document, if not an array
+       * @return false if the document is incomplete or malformed
+       */
+      template < typename Function >
+      bool finish( Function element ) {
+        if ( state == state_type::single ) {
+          element( text );
+          text.clear( );
+          state = state_type::end;
+        }
+
+        return state == state_type::end;
+      }
+
+     private:
+      /**
+       * @brief Account for a character within an element
+       * @param ch character
+       * @return true if it is part of the element's text
+       */
+      bool scan( char ch ) {
+        if ( quoted ) {
+          quoted  = escaped || ( ch != '"' );
+          escaped = !escaped && ( ch == '\\' );
+        } else if ( ch == '"' ) {
+          quoted = true;
+        } else if ( ch == '{' || ch == '[' ) {
+          ++depth;
+        } else if ( ( ch == '}' || ch == ']' ) && depth ) {
+          --depth;
+        } else if ( !depth && ( ch == ',' || ch == ']' ||
+                                std::isspace( static_cast< unsigned char >( ch ) ) ) ) {
+          return false;
+        }
+
+        text.push_back( ch );
+        state = state_type::element;
+        return true;
+      }
+    };
+  } // namespace app
+} // namespace token
+
+#endif // __JSONSPLIT_HH_
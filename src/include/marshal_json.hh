@@ -1,76 +1,297 @@
 #ifndef __MARSHAL_JSON_H_
 #define __MARSHAL_JSON_H_
 
-#include "api/marshal/types/base.hh"
+#include "api/marshal/types/fields.hh"
+#include <array>
+#include <boost/beast/core/string.hpp>
+#include <boost/utility/string_view.hpp>
 #include <nlohmann/json.hpp>
 
 namespace token {
   namespace api {
     namespace marshal {
+      /**
+       * @brief JSON wire form
+       */
       struct json {
         using value_type = ::nlohmann::json;
 
-        struct getter : public base::getter {
-          const value_type &json;
+        static const char *media( ) { return "application/json"; }
 
-          getter( const value_type &j )
-            : json( j ) {}
+        /**
+         * @brief Identify the form's media type
+         * @param type media type, without parameters
+         * @return true if this form's
+         */
+        static bool accepts( boost::string_view type ) {
+          return boost::beast::iequals( type, "application/json" );
+        }
 
-          template < typename T >
-          T get( std::string id ) {
-            try {
-              auto it = json.find( id );
-              if ( it != json.end( ) ) {
-                return it->get< T >( );
-              }
-            } catch ( nlohmann::detail::type_error &ex ) {
-              throw MarshalError( ex.what( ) );
-            } catch ( std::out_of_range &ex ) {
+        /**
+         * @brief Decode a message body
+         * @param body message body
+         * @return decoded value
+         */
+        static value_type parse( boost::string_view body ) {
+          return value_type::parse( body.begin( ), body.end( ) );
+        }
+
+        /**
+         * @brief Encode a message body (compact), into its storage
+         * @param value value to encode
+         * @param out [out] message body
+         */
+        static void dump( const value_type &value, std::string &out ) {
+          out.clear( );
+          append( value, out );
+        }
+
+        /**
+         * @brief Encode a value (compact), straight onto the end of a message body
+         * @param value value to encode
+         * @param out [out] message body, appended to
+         */
+        static void append( const value_type &value, std::string &out ) {
+          nlohmann::detail::serializer< value_type > serializer(
+            nlohmann::detail::output_adapter< char >( out ), ' ' );
+          serializer.dump( value, false, false, 0 );
+        }
+
+        /** Fields read from a request */
+        using read = fields::table< fields::userId,
+                                    fields::token,
+                                    fields::value,
+                                    fields::mask,
+                                    fields::expiration,
+                                    fields::properties >;
+
+        /** Fields written to a response */
+        using write = fields::all;
+
+        /**
+         * @brief Read a string field, if present
+         * @param json request; its value is moved out if it isn't const
+         * @param out [out] value
+         */
+        template < typename Json, typename Field >
+        static void get( Json &json, Field, std::string &out ) {
+          try {
+            auto it = json.find( Field::key( ) );
+            if ( it != json.end( ) ) {
+              out = take( *it );
             }
-            return { };
+          } catch ( nlohmann::detail::type_error &ex ) {
+            throw MarshalError( ex.what( ) );
           }
+        }
 
-          std::string                          userId( ) override { return get< std::string >( "userId" ); }
-          std::string                          token( ) override { return get< std::string >( "token" ); }
-          std::string                          value( ) override { return get< std::string >( "value" ); }
-          std::string                          mask( ) override { return get< std::string >( "mask" ); }
-          std::string                          expiration( ) override { return get< std::string >( "expiration" ); }
-          std::map< std::string, std::string > properties( ) override {
-            std::map< std::string, std::string > rc;
-            auto                                 it = json.find( "properties" );
+        /**
+         * @brief Read the properties, a list of name/value objects
+         * @param json request; its values are moved out if it isn't const
+         * @param out [out] properties
+         */
+        template < typename Json >
+        static void get( Json &json, fields::properties, fields::map_type &out ) {
+          try {
+            auto it = json.find( fields::properties::key( ) );
 
             if ( it != json.end( ) ) {
-              for ( auto &aobj : it->items( ) ) {
-                auto &entry           = aobj.value( );
-                rc[ entry[ "name" ] ] = entry[ "value" ].get< std::string >( );
+              for ( auto &entry : *it ) {
+                out[ entry.at( "name" ).template get< std::string >( ) ] =
+                  take( entry.at( "value" ) );
               }
             }
+          } catch ( nlohmann::detail::exception &ex ) {
+            throw MarshalError( ex.what( ) );
+          }
+        }
+
+        /**
+         * @brief Write a string field
+         * @param json response
+         * @param value field value
+         */
+        template < typename Field >
+        static void set( value_type &json, Field, std::string &&value ) {
+          json[ Field::key( ) ] = std::move( value );
+        }
+
+        /**
+         * @brief Write a map field, as an object
+         * @param json response
+         * @param value field value
+         */
+        template < typename Field >
+        static void set( value_type &json, Field, fields::map_type &&value ) {
+          auto &object = json[ Field::key( ) ] = value_type::object( );
+
+          for ( auto &pair : value ) {
+            object.emplace( pair.first, std::move( pair.second ) );
+          }
+        }
+
+        static void clear( value_type &json ) { json.clear( ); }
+
+       private:
+        static std::string &&take( value_type &value ) {
+          return std::move( value.get_ref< std::string & >( ) );
+        }
+
+        static std::string take( const value_type &value ) { return value.get< std::string >( ); }
+      };
+
+      /**
+       * @brief MessagePack wire form; the JSON form's fields, binary encoded
+       */
+      struct msgpack : json {
+        static const char *media( ) { return "application/msgpack"; }
+
+        static bool accepts( boost::string_view type ) {
+          return boost::beast::iequals( type, "application/msgpack" ) ||
+                 boost::beast::iequals( type, "application/x-msgpack" ) ||
+                 boost::beast::iequals( type, "application/vnd.msgpack" );
+        }
+
+        static value_type parse( boost::string_view body ) {
+          return value_type::from_msgpack( body.begin( ), body.end( ) );
+        }
+
+        static void dump( const value_type &value, std::string &out ) {
+          out.clear( );
+          value_type::to_msgpack( value, out );
+        }
+      };
+
+      /**
+       * @brief CBOR wire form; the JSON form's fields, binary encoded
+       */
+      struct cbor : json {
+        static const char *media( ) { return "application/cbor"; }
+
+        static bool accepts( boost::string_view type ) {
+          return boost::beast::iequals( type, "application/cbor" );
+        }
 
-            return rc;
+        static value_type parse( boost::string_view body ) {
+          return value_type::from_cbor( body.begin( ), body.end( ) );
+        }
+
+        static void dump( const value_type &value, std::string &out ) {
+          out.clear( );
+          value_type::to_cbor( value, out );
+        }
+      };
+
+      /**
+       * @brief Wire encoding of a message body, chosen per request by media type
+       *
+       * The forms share the JSON form's fields (Marshal with json), only their encoding differs.
+       */
+      class Encoding {
+        using value_type = json::value_type;
+        using parse_type = value_type ( * )( boost::string_view );
+        using dump_type  = void ( * )( const value_type &, std::string & );
+        using match_type = bool ( * )( boost::string_view );
+
+        const char *name;
+        parse_type  decoder;
+        dump_type   encoder;
+        match_type  matcher;
+
+        Encoding( const char *_name, parse_type _decoder, dump_type _encoder, match_type _matcher )
+          : name( _name )
+          , decoder( _decoder )
+          , encoder( _encoder )
+          , matcher( _matcher ) {}
+
+        template < typename Mapper >
+        static Encoding of( ) {
+          return Encoding( Mapper::media( ), &Mapper::parse, &Mapper::dump, &Mapper::accepts );
+        }
+
+        static const std::array< Encoding, 3 > &known( ) {
+          static const std::array< Encoding, 3 > encodings{
+            { of< json >( ), of< msgpack >( ), of< cbor >( ) } };
+          return encodings;
+        }
+
+        /**
+         * @brief The media type of a header value, without parameters or surrounding spaces
+         * @param type header value
+         * @return media type
+         */
+        static boost::string_view essence( boost::string_view type ) {
+          type       = type.substr( 0, type.find( ';' ) );
+          auto begin = type.find_first_not_of( " \t" );
+
+          if ( begin == type.npos ) {
+            return { };
+          }
+
+          return type.substr( begin, type.find_last_not_of( " \t" ) - begin + 1 );
+        }
+
+       public:
+        /**
+         * @brief Constructor; JSON
+         */
+        Encoding( )
+          : Encoding( of< json >( ) ) {}
+
+        /**
+         * @brief Find the encoding of a media type (Content-Type)
+         * @param type media type
+         * @param fallback encoding if the type is missing or unknown
+         * @return encoding
+         */
+        static Encoding content( boost::string_view type, Encoding fallback = Encoding( ) ) {
+          type = essence( type );
+
+          for ( auto &encoding : known( ) ) {
+            if ( encoding.matcher( type ) ) {
+              return encoding;
+            }
           }
-        };
-
-        struct setter : public base::setter {
-          value_type &json;
-
-          setter( value_type &j )
-            : json( j ) {}
-
-          void userId( const std::string &value ) override { json[ "userId" ] = value; }
-          void token( const std::string &value ) override { json[ "token" ] = value; }
-          void value( const std::string &value ) override { json[ "value" ] = value; }
-          void mask( const std::string &value ) override { json[ "mask" ] = value; }
-          void expiration( const std::string &value ) override { json[ "expiration" ] = value; }
-          void lastUsed( const std::string &value ) override { json[ "lastUsed" ] = value; }
-          void lastUpdated( const std::string &value ) override { json[ "lastUpdated" ] = value; }
-          void status( const std::string &value ) override { json[ "status" ] = value; }
-          void error( const std::map< std::string, std::string > &value ) override { json[ "error" ] = value; }
-          void properties( const std::map< std::string, std::string > &value ) override {
-            json[ "properties" ] = value;
+
+          return fallback;
+        }
+
+        /**
+         * @brief Choose the first known encoding of those accepted (Accept); wildcards and
+         *        quality values aren't weighed
+         * @param accept comma separated media types
+         * @param fallback encoding if none is known
+         * @return encoding
+         */
+        static Encoding accept( boost::string_view accept, Encoding fallback ) {
+          while ( !accept.empty( ) ) {
+            auto comma = accept.find( ',' );
+            auto type  = essence( accept.substr( 0, comma ) );
+
+            for ( auto &encoding : known( ) ) {
+              if ( encoding.matcher( type ) ) {
+                return encoding;
+              }
+            }
+
+            accept = ( comma == accept.npos ) ? boost::string_view( ) : accept.substr( comma + 1 );
           }
 
-          void clear( ) override { json.clear( ); }
-        };
+          return fallback;
+        }
+
+        /**
+         * @brief Identify the encoding
+         * @return true if it's the Mapper's
+         */
+        template < typename Mapper >
+        bool is( ) const {
+          return decoder == &Mapper::parse;
+        }
+
+        const char *media( ) const { return name; }
+        value_type  parse( boost::string_view body ) const { return decoder( body ); }
+        void dump( const value_type &value, std::string &out ) const { encoder( value, out ); }
       };
     } // namespace marshal
   }   // namespace api
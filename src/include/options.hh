@@ -53,6 +53,7 @@ class Options {
 
     user.add_options( )                                              //
       ( "create-user", "Create a new user" )                         //
+      ( "set-password", "Change a user's password" )                 //
       ( "grant,g", "Grant vault permissions" )                       //
       ( "limit,L", "Enable rate Limit" )                             //
       ( "user,u", po::value< std::string >( ), "User name" )         //
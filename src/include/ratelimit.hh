@@ -0,0 +1,169 @@
+#ifndef __RATELIMIT_HH_
+#define __RATELIMIT_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace token {
+  namespace app {
+
+    /**
+     * @brief Per user/vault request allowance
+     *
+     * Implements GCRA (a token bucket expressed as a single 'theoretical arrival time'), so an
+     * acquisition is one compare-and-swap; `value` requests are allowed per `period`, with the
+     * full allowance available as a burst.
+     *
+     * When several nodes share the limits, the bucket instead spends a lease: a slice of the
+     * period's allowance reserved from user_limits, see AuthTokenDB::lease( ).
+     */
+    struct LimitBucket {
+      using clock_type = std::chrono::steady_clock;
+
+      const int32_t     configId; /**< user_limits_config id             */
+      const uint32_t    uid;      /**< User id                           */
+      const std::string vault;    /**< Vault table name                  */
+      const uint32_t    value;    /**< Requests allowed per period       */
+      const int64_t     period;   /**< Period length (ns)                */
+      const int64_t     interval; /**< Emission interval, period / value */
+
+      std::atomic< int64_t >  tat;      /**< Theoretical arrival time (ns)         */
+      std::atomic< uint32_t > consumed; /**< Allowance used since the last flush   */
+
+      std::mutex              leaseLock;   /**< Serializes lease reservations           */
+      std::atomic< uint32_t > leased;      /**< Unspent allowance reserved from the db  */
+      std::atomic< int64_t >  leaseExpire; /**< When the unspent lease is handed back   */
+      std::atomic< int64_t >  exhausted;   /**< Don't ask the db for more before (ns)   */
+
+      LimitBucket( int32_t     _configId,
+                   uint32_t    _uid,
+                   std::string _vault,
+                   uint32_t    _value,
+                   int64_t     _period )
+        : configId( _configId )
+        , uid( _uid )
+        , vault( std::move( _vault ) )
+        , value( std::max< uint32_t >( 1, _value ) )
+        , period( std::max< int64_t >( 1, _period ) )
+        , interval( std::max< int64_t >( 1, period / value ) )
+        , tat( 0 )
+        , consumed( 0 )
+        , leased( 0 )
+        , leaseExpire( 0 )
+        , exhausted( 0 ) {}
+
+      /**
+       * @brief Current time on the bucket clock
+       * @return nanoseconds
+       */
+      static int64_t now( ) {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >(
+                 clock_type::now( ).time_since_epoch( ) )
+          .count( );
+      }
+
+      /**
+       * @brief Pre-charge the bucket with allowance already used in the current period
+       * @param used number of requests already allowed
+       */
+      void charge( uint32_t used ) {
+        tat.store( now( ) + static_cast< int64_t >( std::min( used, value ) ) * interval );
+      }
+
+      /**
+       * @brief Take up to `count` requests worth of allowance
+       * @param count number of requests
+       * @return number of requests allowed (0 when throttled)
+       */
+      uint32_t acquire( uint32_t count ) {
+        int64_t  current = now( );
+        int64_t  prior   = tat.load( std::memory_order_relaxed );
+        int64_t  next    = 0;
+        uint32_t granted = 0;
+
+        do {
+          int64_t base  = std::max( prior, current );
+          int64_t spare = current + period - base;
+
+          if ( spare < interval ) {
+            return 0;
+          }
+
+          granted = static_cast< uint32_t >( std::min< int64_t >( count, spare / interval ) );
+          next    = base + granted * interval;
+        } while ( !tat.compare_exchange_weak( prior, next, std::memory_order_acq_rel ) );
+
+        consumed.fetch_add( granted, std::memory_order_relaxed );
+
+        return granted;
+      }
+
+      /**
+       * @brief Spend up to `count` requests from the locally held lease
+       * @param count number of requests
+       * @return number of requests allowed from the lease
+       */
+      uint32_t take( uint32_t count ) {
+        uint32_t prior   = leased.load( std::memory_order_relaxed );
+        uint32_t granted = 0;
+
+        do {
+          granted = std::min( prior, count );
+
+          if ( !granted ) {
+            return 0;
+          }
+        } while (
+          !leased.compare_exchange_weak( prior, prior - granted, std::memory_order_acq_rel ) );
+
+        return granted;
+      }
+    };
+
+    /**
+     * @brief Atomically published set of rate limit buckets, keyed by user and vault id
+     */
+    class RateLimiter {
+     public:
+      using bucket_map = std::unordered_map< uint64_t, std::shared_ptr< LimitBucket > >;
+
+     private:
+      std::shared_ptr< const bucket_map > current;
+
+     public:
+      /**
+       * @brief Build the bucket key
+       * @param uid user id
+       * @param vault vault id
+       * @return map key
+       */
+      static uint64_t key( uint32_t uid, int32_t vault ) {
+        return ( static_cast< uint64_t >( uid ) << 32 ) | static_cast< uint32_t >( vault );
+      }
+
+      /**
+       * @brief Get the current buckets
+       * @return buckets, or null if nothing has been loaded
+       */
+      std::shared_ptr< const bucket_map > snapshot( ) const {
+        return std::atomic_load( &current );
+      }
+
+      /**
+       * @brief Replace the current buckets
+       * @param buckets new bucket set
+       */
+      void publish( std::shared_ptr< const bucket_map > buckets ) {
+        std::atomic_store( &current, std::move( buckets ) );
+      }
+    };
+  } // namespace app
+} // namespace token
+
+#endif // __RATELIMIT_HH_
@@ -4,7 +4,9 @@
 #include "api/http.hh"
 #include "api/marshal/marshal.hh"
 #include "authdb.hh"
+#include "auththrottle.hh"
 #include "config.hh"
+#include "jsonsplit.hh"
 #include "marshal_json.hh"
 #include "options.hh"
 #include <algorithm>
@@ -17,7 +19,9 @@
 #include <prometheus/registry.h>
 #include <prometheus/text_serializer.h>
 #include <token/api/manager.hh>
+#include <unordered_map>
 #include <uri/uri.hh>
+#include <vector>
 
 namespace token {
   namespace app {
@@ -67,8 +71,15 @@ namespace token {
         , start( clock_type::now( ) ) {}
 
       ~tracker( ) {
-        std::chrono::duration< double, std::milli > durms = clock_type::now( ) - start;
+        auto                                        elapsed = clock_type::now( ) - start;
+        std::chrono::duration< double, std::milli > durms   = elapsed;
         m.Observe( durms.count( ) );
+
+        // Feeds the concurrency limit of the pool handling the request, if adaptive
+        if ( auto executor = token::async::Executor::current( ) ) {
+          executor->sample(
+            std::chrono::duration_cast< token::async::Executor::duration_type >( elapsed ) );
+        }
       }
     };
 
@@ -79,17 +90,25 @@ namespace token {
       using manager_type       = token::api::TokenManager;
       using database_type      = AuthTokenDB; // token::api::core::TokenDB;
       using executor_type      = token::async::Executor;
+      using priority_type      = executor_type::priority_type;
+      using pool_type          = std::shared_ptr< executor_type >;
+      using pool_map_type      = std::unordered_map< std::string, pool_type >;
       using base_provider_type = token::crypto::Provider;
       using Marshal            = token::api::marshal::Marshal< nlohmann::json, //
                                                     ::token::api::marshal::json >;
+      using Encoding           = token::api::marshal::Encoding;
 
       std::shared_ptr< base_provider_type > provider;
       Options                               options;
       token::app::Config                    config;
       bool                                  initCheck;
       std::shared_ptr< database_type >      tokenDB;
+      std::shared_ptr< AuthThrottle >       throttle;
+      std::chrono::seconds                  sessionTtl;
+      bool                                  pretty; /**< Indented JSON responses */
       std::shared_ptr< manager_type >       manager;
       std::shared_ptr< executor_type >      executor;
+      pool_map_type                         vaultExecutors; /**< Vaults with their own workers */
       std::shared_ptr< service_type >       service;
       boost::asio::ssl::context             ctx;
       histogram_type *                      resp_time;
@@ -273,6 +292,15 @@ namespace token {
                                 options.get< std::string >( "token" ) );
         }
 
+        if ( options.has( "set-password" ) ) {
+          if ( !options.has( "password" ) ) {
+            std::cerr << "Must supply a password to change a user's password\n";
+            exit( 1 );
+          }
+
+          tokenDB->set_password( user, options.get< std::string >( "password" ) );
+        }
+
         if ( options.has( "grant" ) ) {
           tokenDB->grant_user( user, options.get< std::string >( "vault" ) );
         }
@@ -301,8 +329,9 @@ namespace token {
           return;
         } else if ( ( options.has( "create-vault" ) ) || ( options.has( "rekey" ) ) ) {
           processVaultCmd( );
-        } else if ( options.has( "create-user" ) || //
-                    options.has( "grant" ) ||       //
+        } else if ( options.has( "create-user" ) ||  //
+                    options.has( "set-password" ) || //
+                    options.has( "grant" ) ||        //
                     options.has( "limit" ) ) {
           processUserCmd( );
         } else if ( options.has( "stop" ) ) {
@@ -312,39 +341,109 @@ namespace token {
         exit( 0 );
       }
 
+      /**
+       * @brief Split a request's Authorization header
+       * @param request request headers
+       * @param type [out] authorization scheme, lower case
+       * @param credential [out] scheme credential
+       */
+      static void credentials( service_type::request_type &request,
+                               std::string &               type,
+                               std::string &               credential ) {
+        auto auth  = request[ http::field::authorization ];
+        auto space = auth.find( ' ' );
+
+        type       = std::string( auth.substr( 0, space ) );
+        credential = std::string( auth.substr( space + 1 ) );
+
+        std::transform( type.begin( ), type.end( ), type.begin( ), []( uint8_t ch ) -> uint8_t {
+          return std::tolower( ch );
+        } );
+      }
+
+      /**
+       * @brief Identify who a request is made for, from what's already known of its credential;
+       *        for scheduling only, nothing is validated (see authorized( ))
+       * @param request request headers
+       * @return user id, 0 if the credential is neither remembered on the connection nor cached
+       *         as valid
+       */
+      uint32_t requester( service_type::request_type &request ) {
+        auto        connection = token::api::http::Connection::current( );
+        std::string type, credential;
+
+        if ( request[ http::field::authorization ].empty( ) ) {
+          return 0;
+        }
+
+        credentials( request, type, credential );
+
+        auto identity = connection ? connection->recall( AuthCache::fingerprint( type, credential ),
+                                                         tokenDB->generation( ) )
+                                   : 0;
+
+        return identity ? identity : tokenDB->known( type, credential );
+      }
+
       bool authorized( std::string                  vault,
                        service_type::request_type & request,
                        service_type::response_type &response,
                        uint32_t &                   limit ) {
-        auto     auth  = request[ http::field::authorization ];
-        auto     space = auth.find( ' ' );
-        auto     type  = std::string( auth.substr( 0, space ) );
-        auto     value = auth.substr( space + 1 );
-        uint32_t uid   = 0;
+        auto        connection = token::api::http::Connection::current( );
+        auto        address    = connection ? connection->host_remote( ) : std::string{ };
+        std::string type, credential;
+
+        credentials( request, type, credential );
+
+        auto digest     = connection ? AuthCache::fingerprint( type, credential ) : std::string{ };
+        auto generation = tokenDB->generation( );
+        auto identity   = connection ? connection->recall( digest, generation ) : 0;
+        auto result     = Authorization{ };
+
+        // Only unverified credentials are turned away; a blocked (e.g. shared) address still
+        // serves the ones already known to be good
+        if ( !identity && !address.empty( ) && throttle->blocked( address ) &&
+             !tokenDB->known( type, credential ) ) {
+          static const auto body = error_body( http::status::too_many_requests,
+                                               "Too many failed authentication attempts" );
+          reject( response, http::status::too_many_requests, body );
+          response.set( http::field::retry_after, //
+                        std::to_string( throttle->duration( ).count( ) ) );
+          return false;
+        }
 
-        std::transform( type.begin( ), type.end( ), type.begin( ), []( uint8_t ch ) -> uint8_t {
-          return std::tolower( ch );
-        } );
+        if ( identity ) {
+          // Validated earlier on this connection; only access and limits are left to check
+          result = tokenDB->authorize( identity, vault, limit );
+        } else {
+          result = tokenDB->authorize( type, credential, vault, limit );
+
+          if ( result.uid && connection ) {
+            connection->remember( digest, result.uid, generation, sessionTtl );
+          }
+        }
 
-        if ( type == "basic" ) {
-          uid = tokenDB->authorizedBasic( std::move( std::string( value ) ) );
-        } else if ( type == "bearer" ) {
-          uid = tokenDB->authorizedToken( std::move( std::string( value ) ) );
-        }
-
-        if ( ( uid == 0 ) || ( !tokenDB->accessible( uid, vault ) ) ) {
-          auto status = http::status::unauthorized;
-          response.result( status );
-          response.reason( http::detail::status_to_string( static_cast< unsigned >( status ) ) );
-          response.body( ) =
-            nlohmann::json::object(
-              { { "message", "Attempted to access a secured resource with no valid access" },
-                { "code", std::to_string( static_cast< unsigned >( status ) ) } } )
-              .dump( 2 );
+        if ( result.failed ) {
+          static const auto body = error_body( http::status::service_unavailable,
+                                               "Unable to check access, try again later" );
+          reject( response, http::status::service_unavailable, body );
+          response.set( http::field::retry_after, "1" );
           return false;
         }
 
-        limit = tokenDB->rate_limit( uid, vault, limit );
+        if ( ( result.uid == 0 ) && !address.empty( ) ) {
+          throttle->failure( address );
+        }
+
+        if ( ( result.uid == 0 ) || ( !result.access ) ) {
+          static const auto body =
+            error_body( http::status::unauthorized,
+                        "Attempted to access a secured resource with no valid access" );
+          reject( response, http::status::unauthorized, body );
+          return false;
+        }
+
+        limit = result.allowed;
 
         return true;
       }
@@ -358,18 +457,304 @@ namespace token {
         if ( !authorized( vault, request, response, limit ) ) {
           limit = 0;
         } else if ( !limit ) {
-          auto status = http::status::forbidden;
-          response.result( status );
-          response.reason( http::detail::status_to_string( static_cast< unsigned >( status ) ) );
-          response.body( ) = nlohmann::json::object(
-                               { { "code", std::to_string( static_cast< unsigned >( status ) ) },
-                                 { "message", "Messages have been throttled due to overuse" } } )
-                               .dump( 2 );
+          static const auto body = error_body( http::status::forbidden,
+                                               "Messages have been throttled due to overuse" );
+          reject( response, http::status::forbidden, body );
         }
 
         return limit;
       }
 
+      /**
+       * @brief Serialize an error response body; for those sent often, serialized once
+       * @param status error status
+       * @param message error message
+       * @return response body
+       */
+      static std::string error_body( http::status status, const char *message ) {
+        return nlohmann::json::object(
+                 { { "message", message },
+                   { "code", std::to_string( static_cast< unsigned >( status ) ) } } )
+          .dump( );
+      }
+
+      /**
+       * @brief Turn a request away
+       * @param response response
+       * @param status error status
+       * @param body serialized response body, see error_body( )
+       */
+      static void reject( service_type::response_type &response,
+                          http::status                 status,
+                          const std::string &          body ) {
+        response.result( status );
+        response.reason( http::detail::status_to_string( static_cast< unsigned >( status ) ) );
+        response.set( http::field::content_type, "application/json" );
+        response.body( ) = body;
+      }
+
+      /**
+       * @brief Tokenization of a POSTed body's entries as they arrive
+       *
+       * Each complete array entry is tokenized as soon as it's read, and its result is sent
+       * back straight away; only the entries of the piece of the body in hand are ever held.
+       * Entries past the one allowed with the request headers are rate limited a piece at a
+       * time.  Binary encoded bodies (or responses) can't be split as they arrive, so they're
+       * read whole, up to the entry limit, then answered whole.
+       */
+      class TokenStream : public token::api::http::BodyStream {
+        /** Longest entry (or non-array, or binary, body) accepted */
+        static constexpr size_t entry_limit = 1024 * 1024;
+
+        self_type &                  app;
+        std::string                  vault;
+        service_type::request_type & request;
+        tracker< gauge_type >        reqtrack;
+        Encoding                     decoding; /**< Request body encoding */
+        Encoding                     encoding; /**< Response body encoding */
+        bool                         streamed; /**< Answered entry by entry (JSON both ways) */
+        JsonSplit                    split;
+        std::vector< std::string >   entries; /**< Entries of the piece in hand */
+        std::string                  body;    /**< Request body, if not streamed */
+        size_t                       count  = 0;     /**< Entries answered */
+        uint32_t                     limit  = 1;     /**< Entries allowed; one with the headers */
+        bool                         opened = false; /**< Response array started */
+        bool                         bad    = false; /**< Non-array body answered with an error */
+
+        /** Processing time, from the headers to the end of the response; see finish( ) */
+        std::unique_ptr< tracker< histogram_type > > durtrack;
+
+       public:
+        /**
+         * @brief Constructor
+         * @param _app application
+         * @param _vault vault tokenized into
+         * @param _request request, its headers authorize the entries
+         */
+        TokenStream( self_type &_app, std::string _vault, service_type::request_type &_request )
+          : app( _app )
+          , vault( std::move( _vault ) )
+          , request( _request )
+          , reqtrack( *_app.req_count )
+          , decoding( decoder( _request ) )
+          , encoding( encoder( _request ) )
+          , streamed( decoding.is< token::api::marshal::json >( ) &&
+                      encoding.is< token::api::marshal::json >( ) )
+          , split( entry_limit )
+          , durtrack( new tracker< histogram_type >( *_app.resp_time ) ) {}
+
+        /**
+         * @brief Response body encoding
+         * @return media type
+         */
+        const char *media( ) const { return encoding.media( ); }
+
+        bool write( boost::string_view data, std::string &out ) override {
+          if ( !streamed ) {
+            body.append( data.data( ), data.size( ) );
+
+            if ( body.size( ) > entry_limit ) {
+              fail( out );
+              return false;
+            }
+
+            return true;
+          }
+
+          auto ok = split.write( data, [ & ]( std::string &text ) {
+            entries.emplace_back( std::move( text ) );
+          } );
+
+          if ( split.array( ) && !opened ) {
+            out.push_back( '[' );
+            opened = true;
+          }
+
+          tokenize( out );
+
+          if ( !ok ) {
+            fail( out );
+          }
+
+          return ok;
+        }
+
+        bool finish( std::string &out ) override {
+          // Observed on the way out, on the worker, so it also feeds the pool's adaptive limit
+          auto observed = std::move( durtrack );
+
+          if ( !streamed ) {
+            return whole( out );
+          }
+
+          auto ok = split.finish( [ & ]( std::string &text ) {
+            entries.emplace_back( std::move( text ) );
+          } );
+
+          tokenize( out );
+
+          if ( !ok ) {
+            fail( out );
+            return false;
+          } else if ( opened ) {
+            out.push_back( ']' );
+          }
+
+          ( bad ? app.req_bad : app.req_good )->Increment( );
+          return true;
+        }
+
+       private:
+        /**
+         * @brief Draw on the rate limit for the entries beyond those already allowed
+         * @param entries entry count
+         */
+        void allow( size_t entries ) {
+          if ( entries > limit ) {
+            uint32_t more  = entries - limit;
+            auto     scrap = service_type::response_type{ };
+            limit += app.authorized( vault, request, scrap, more ) ? more : 0;
+          }
+        }
+
+        /**
+         * @brief Tokenize an entry
+         * @param body request entry
+         * @return response entry
+         */
+        nlohmann::json answer( nlohmann::json &&body ) {
+          auto resp_entry = nlohmann::json::object( );
+          auto entry      = token::api::TokenEntry{ };
+
+          if ( !limit ) {
+            entry_error(
+              resp_entry, http::status::forbidden, "Messages have been throttled due to overuse" );
+            return resp_entry;
+          }
+
+          --limit;
+
+          Marshal{ }
+            .from( [ & ]( ) -> token::api::TokenEntry {
+              Marshal{ std::move( body ) }.to( entry );
+              return app.manager->tokenize( vault, entry.value, &entry );
+            } )
+            .to( resp_entry );
+
+          return resp_entry;
+        }
+
+        /**
+         * @brief Tokenize the entries in hand
+         * @param out [out] response body, appended to
+         */
+        void tokenize( std::string &out ) {
+          allow( entries.size( ) );
+
+          for ( auto &text : entries ) {
+            auto resp_entry = nlohmann::json::object( );
+
+            try {
+              resp_entry = answer( nlohmann::json::parse( text ) );
+            } catch ( nlohmann::detail::parse_error &ex ) {
+              entry_error( resp_entry, http::status::bad_request, "Malformed entry" );
+            }
+
+            out.append( ( opened && count++ ) ? "," : "" );
+            token::api::marshal::json::append( resp_entry, out );
+            bad = !opened && ( resp_entry.find( "error" ) != resp_entry.end( ) );
+          }
+
+          entries.clear( );
+        }
+
+        /**
+         * @brief Tokenize a body read whole
+         * @param out [out] response body
+         * @return false if the body is malformed
+         */
+        bool whole( std::string &out ) {
+          auto document = nlohmann::json( );
+
+          try {
+            document = decoding.parse( body );
+          } catch ( nlohmann::detail::exception &ex ) {
+            fail( out );
+            return false;
+          }
+
+          auto resp = nlohmann::json::array( );
+
+          if ( document.is_array( ) ) {
+            allow( document.size( ) );
+
+            for ( auto &entry : document ) {
+              resp.emplace_back( answer( std::move( entry ) ) );
+            }
+          } else {
+            resp = answer( std::move( document ) );
+            bad  = resp.find( "error" ) != resp.end( );
+          }
+
+          encoding.dump( resp, out );
+          ( bad ? app.req_bad : app.req_good )->Increment( );
+          return true;
+        }
+
+        /**
+         * @brief End the response on a malformed body
+         * @param out [out] response body, appended to
+         */
+        void fail( std::string &out ) {
+          auto resp_entry = nlohmann::json::object( );
+
+          entry_error( resp_entry, http::status::bad_request, "Malformed request body" );
+          app.req_bad->Increment( );
+          durtrack.reset( );
+
+          if ( opened ) {
+            out.append( count++ ? "," : "" );
+            token::api::marshal::json::append( resp_entry, out );
+            out.push_back( ']' );
+          } else if ( streamed ) {
+            token::api::marshal::json::append( resp_entry, out );
+          } else {
+            encoding.dump( resp_entry, out );
+          }
+        }
+
+        /**
+         * @brief Set an entry's error result
+         * @param resp_entry [out] response entry
+         * @param status error status
+         * @param message error message
+         */
+        static void entry_error( nlohmann::json &resp_entry,
+                                 http::status    status,
+                                 const char *    message ) {
+          resp_entry[ "code" ]    = std::to_string( static_cast< unsigned >( status ) );
+          resp_entry[ "message" ] = message;
+        }
+      };
+
+      /**
+       * @brief Request body encoding, by its Content-Type; JSON by default
+       * @param request request
+       * @return encoding
+       */
+      static Encoding decoder( service_type::request_type &request ) {
+        return Encoding::content( request[ http::field::content_type ] );
+      }
+
+      /**
+       * @brief Response body encoding, by the request's Accept; as the request's by default
+       * @param request request
+       * @return encoding
+       */
+      static Encoding encoder( service_type::request_type &request ) {
+        return Encoding::accept( request[ http::field::accept ], decoder( request ) );
+      }
+
      public:
       Tokenization( int         argc,
                     const char *argv[],
@@ -422,9 +807,152 @@ namespace token {
         req_bad   = &requests.Add( { { "result", "failure" } } );
         req_count = &count.Add( { { "state", "processing" } } );
 
-        executor = std::make_shared< executor_type >( config.workerPoolSize( ) );
+        auto authCache = std::make_shared< AuthCache >( //
+          config.authCacheSize( ),
+          std::chrono::seconds( config.authCacheTtl( ) ),
+          config.authCacheShards( ),
+          std::chrono::seconds( config.authCacheNegativeTtl( ) ) );
+        authCache->metrics( registry );
+        throttle = std::make_shared< AuthThrottle >( //
+          std::max( config.authFailureLimit( ), 0 ),
+          std::chrono::seconds( config.authFailureWindow( ) ),
+          std::chrono::seconds( config.authFailureBlock( ) ),
+          config.authCacheSize( ),
+          config.authCacheShards( ) );
+        throttle->metrics( registry );
+        sessionTtl = std::chrono::seconds( config.authSessionTtl( ) );
+        tokenDB->cache( authCache );
+        tokenDB->metrics( registry );
+        tokenDB->lease_start( std::max( config.rateLimitLeaseSize( ), 0 ),
+                              std::chrono::milliseconds( config.rateLimitLeaseTtl( ) ) );
+        tokenDB->acl_start( std::chrono::milliseconds( config.authAclRefresh( ) ),
+                            config.rateLimitLocal( ) );
+
+        auto &depth = prometheus::BuildHistogram( )
+                        .Name( "queue_depth" )
+                        .Help( "Number of requests queued when a worker took one" )
+                        .Register( registry )
+                        .Add( { },
+                              histogram_type::BucketBoundaries{
+                                0, 1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 } );
+        auto  waits = histogram_type::BucketBoundaries{
+          0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 1000, 5000 };
+        auto &wait = prometheus::BuildHistogram( )
+                       .Name( "queue_wait" )
+                       .Help( "How long a request waited for a worker (ms)" )
+                       .Register( registry )
+                       .Add( { }, waits );
+        auto &userWait = prometheus::BuildHistogram( )
+                           .Name( "user_queue_wait" )
+                           .Help( "How long a weighted user's request waited for a worker (ms); "
+                                  "other users' are counted together" )
+                           .Register( registry );
+        auto &limits   = prometheus::BuildGauge( )
+                           .Name( "concurrency_limit" )
+                           .Help( "Number of requests a worker pool may handle at once" )
+                           .Register( registry );
+
+        auto weights   = config.workerWeights( );
+        auto otherWait = &userWait.Add( { { "user", "other" } }, waits );
+        auto userWaits = std::make_shared< std::map< uint32_t, histogram_type * > >( );
+
+        // Resolved once, so observing is just a lookup; only weighted users get their own label,
+        // which keeps the label set bounded
+        for ( auto &weight : weights ) {
+          ( *userWaits )[ weight.first ] =
+            &userWait.Add( { { "user", std::to_string( weight.first ) } }, waits );
+        }
+
+        auto pool = [ & ]( const std::string &name, int size ) {
+          auto adaptive = config.workerLimitAdaptive( );
+          auto ceiling  = config.workerLimitMax( );
+          auto result   = std::make_shared< executor_type >(
+            ( adaptive && ( ceiling > std::max( size, 0 ) ) ) ? ceiling : size );
+          auto limiter  = std::shared_ptr< token::async::AdaptiveLimit >( );
+          auto limit    = &limits.Add( { { "pool", name } } );
+
+          result->bound( std::max( config.workerQueueDepth( ), 0 ),
+                         std::chrono::milliseconds( config.workerQueueWait( ) ) );
+
+          for ( auto &weight : weights ) {
+            result->weigh( weight.first, weight.second );
+          }
+
+          if ( adaptive ) {
+            // Workers for the ceiling; those over the limit stay parked until it grows
+            limiter = std::make_shared< token::async::AdaptiveLimit >(
+              std::max( size, 1 ),
+              std::max( config.workerLimitMin( ), 1 ),
+              result->size( ) );
+            result->limit( limiter );
+          }
+
+          limit->Set( limiter ? limiter->limit( ) : result->size( ) );
+
+          result->observe(
+            [ &depth, &wait, userWaits, otherWait, limiter, limit ](
+              size_t queued, executor_type::duration_type waited, executor_type::flow_type user ) {
+              auto ms    = std::chrono::duration< double, std::milli >( waited ).count( );
+              auto found = userWaits->find( user );
+
+              depth.Observe( queued );
+              wait.Observe( ms );
+              ( found == userWaits->end( ) ? otherWait : found->second )->Observe( ms );
+
+              if ( limiter ) {
+                limit->Set( limiter->limit( ) );
+              }
+            } );
+
+          return result;
+        };
+
+        executor = pool( "shared", config.workerPoolSize( ) );
         service  = std::make_shared< service_type >( executor, config.restPoolSize( ) );
 
+        if ( config.restPerThread( ) ) {
+          service->setPerThread( config.restPin( ) );
+        }
+
+        service->setPipeline( std::max( config.restPipeline( ), 1 ) );
+        service->setStreams( std::max( config.restStreams( ), 0 ) );
+        pretty = config.restPretty( );
+
+        for ( auto &vault : config.vaultPoolSizes( ) ) {
+          vaultExecutors[ vault.first ] = pool( vault.first, vault.second );
+        }
+
+        if ( !vaultExecutors.empty( ) ) {
+          service->setDispatch(
+            [ this ]( const service_type::param_map_type &params ) -> executor_type * {
+              auto vault = params[ "vault" ];
+
+              if ( vault.empty( ) ) {
+                return nullptr;
+              }
+
+              auto found = vaultExecutors.find( vault.to_string( ) );
+              return ( found == vaultExecutors.end( ) ) ? nullptr : found->second.get( );
+            } );
+        }
+
+        // Bodies are only read once the client is known to be allowed to send them
+        service->setGuard( [ this ]( service_type::param_map_type &params,
+                                     service_type::request_type &  request,
+                                     service_type::response_type & response ) -> bool {
+          if ( !preliminary( params[ "vault" ].to_string( ), request, response, nullptr ) ) {
+            req_limit->Increment( );
+            return false;
+          }
+
+          return true;
+        } );
+
+        // Requests are queued on behalf of their user, see Executor::weigh( )
+        service->setRequester( [ this ]( service_type::request_type &request ) -> uint32_t {
+          return requester( request );
+        } );
+
         if ( ( ssl_key.empty( ) ) || ( ssl_cert.empty( ) ) ) {
           service->addListener( config.listenerAddress( ), config.listenerPort( ) );
         } else {
@@ -449,10 +977,9 @@ namespace token {
                                 service_type::response_type & response ) -> bool {
                         tracker< gauge_type >     reqtrack( *req_count );
                         tracker< histogram_type > dur_track( *resp_time );
-                        uint32_t                  limit = preliminary( params[ "vault" ], //
-                                                      request,
-                                                      response,
-                                                      nullptr );
+                        std::string               vault = params[ "vault" ].to_string( );
+                        uint32_t                  limit =
+                          preliminary( vault, request, response, nullptr );
 
                         if ( !limit ) {
                           req_limit->Increment( );
@@ -463,11 +990,11 @@ namespace token {
 
                         Marshal{ }
                           .from( [ & ]( ) -> token::api::TokenEntry {
-                            return manager->detokenize( params[ "vault" ], params[ "token" ] );
+                            return manager->detokenize( vault, params[ "token" ].to_string( ) );
                           } )
                           .to( obj );
 
-                        response_set( response, obj );
+                        response_set( request, response, obj );
 
                         return true;
                       } );
@@ -478,89 +1005,38 @@ namespace token {
                                 service_type::response_type & response ) -> bool {
                         tracker< gauge_type >     reqtrack( *req_count );
                         tracker< histogram_type > dur_track( *resp_time );
-                        auto                      body  = nlohmann::json::parse( request.body( ) );
-                        uint32_t                  limit = preliminary( params[ "vault" ], //
-                                                      request,
-                                                      response,
-                                                      &body );
-
-                        if ( !limit ) {
-                          req_limit->Increment( );
-                          return true;
-                        }
+                        std::string               vault = params[ "vault" ].to_string( );
 
+                        auto body  = decoder( request ).parse( request.body( ) );
                         auto ret   = nlohmann::json::object( );
                         auto entry = token::api::TokenEntry{ };
 
-                        Marshal{ body }
+                        Marshal{ std::move( body ) }
                           .to( entry )
-                          .setToken( params[ "token" ] )
+                          .setToken( params[ "token" ].to_string( ) )
                           .from( [ & ]( ) -> token::api::TokenEntry {
-                            return manager->tokenize( params[ "vault" ], entry.value, &entry );
+                            return manager->tokenize( vault, entry.value, &entry );
                           } )
                           .to( ret );
 
-                        response_set( response, ret );
+                        response_set( request, response, ret );
 
                         return true;
-                      } );
-
-        service->post( "/vaults/{vault}/token",
-                       [ this ]( service_type::param_map_type &params,
-                                 service_type::request_type &  request,
-                                 service_type::response_type & response ) -> bool {
-                         tracker< gauge_type >     reqtrack( *req_count );
-                         tracker< histogram_type > dur_track( *resp_time );
-                         nlohmann::json            resp_array = nlohmann::json::array( );
-                         nlohmann::json            req_array;
-                         auto                      body  = nlohmann::json::parse( request.body( ) );
-                         uint32_t                  limit = preliminary( params[ "vault" ], //
-                                                       request,
-                                                       response,
-                                                       &body );
-
-                         if ( !limit ) {
-                           req_limit->Increment( );
-                           return true;
-                         }
-
-                         auto ret = nlohmann::json::object( );
-
-                         if ( body.is_array( ) ) {
-                           req_array = body;
-                         } else {
-                           req_array = nlohmann::json::array( );
-                           req_array.emplace_back( body );
-                         }
-
-                         for ( auto &rs : req_array.items( ) ) {
-                           auto resp_entry = nlohmann::json::object( );
-                           auto entry      = token::api::TokenEntry{ };
-
-                           if ( !limit ) {
-                             auto status = http::status::forbidden;
-
-                             resp_entry[ "code" ] =
-                               std::to_string( static_cast< unsigned >( status ) );
-                             resp_entry[ "message" ] =
-                               "Messages have been throttled due to overuse";
-                           } else {
-                             Marshal{ rs.value( ) }
-                               .to( entry )
-                               .from( [ & ]( ) -> token::api::TokenEntry {
-                                 return manager->tokenize( params[ "vault" ], entry.value, &entry );
-                               } )
-                               .to( resp_entry );
-
-                             --limit;
-                           }
-
-                           resp_array.emplace_back( resp_entry );
-                         }
-
-                         response_set( response, body.is_array( ) ? resp_array : resp_array[ 0 ] );
-                         return true;
-                       } );
+                      },
+                      token::api::http::Guard::headers );
+
+        service->stream( http::verb::post,
+                         "/vaults/{vault}/token",
+                         [ this ]( service_type::param_map_type &params,
+                                   service_type::request_type &  request,
+                                   service_type::response_type & response )
+                           -> std::unique_ptr< token::api::http::BodyStream > {
+                           auto stream = std::unique_ptr< TokenStream >(
+                             new TokenStream( *this, params[ "vault" ].to_string( ), request ) );
+                           response.set( http::field::content_type, stream->media( ) );
+                           return std::move( stream );
+                         },
+                         token::api::http::Guard::headers );
 
         service->del( "/vaults/{vault}/token/{token}",
                       [ this ]( service_type::param_map_type &params,
@@ -568,10 +1044,9 @@ namespace token {
                                 service_type::response_type & response ) -> bool {
                         tracker< gauge_type >     reqtrack( *req_count );
                         tracker< histogram_type > dur_track( *resp_time );
-                        uint32_t                  limit = preliminary( params[ "vault" ], //
-                                                      request,
-                                                      response,
-                                                      nullptr );
+                        std::string               vault = params[ "vault" ].to_string( );
+                        uint32_t                  limit =
+                          preliminary( vault, request, response, nullptr );
 
                         if ( !limit ) {
                           req_limit->Increment( );
@@ -582,11 +1057,11 @@ namespace token {
 
                         Marshal{ }
                           .from( [ & ]( ) -> token::api::TokenEntry {
-                            return manager->remove( params[ "vault" ], params[ "token" ] );
+                            return manager->remove( vault, params[ "token" ].to_string( ) );
                           } )
                           .to( resp );
 
-                        response_set( response, resp );
+                        response_set( request, response, resp );
 
                         return true;
                       } );
@@ -597,10 +1072,9 @@ namespace token {
                                 service_type::response_type & response ) -> bool {
                         tracker< gauge_type >     reqtrack( *req_count );
                         tracker< histogram_type > dur_track( *resp_time );
-                        uint32_t                  limit = preliminary( params[ "vault" ], //
-                                                      request,
-                                                      response,
-                                                      nullptr );
+                        std::string               vault = params[ "vault" ].to_string( );
+                        uint32_t                  limit =
+                          preliminary( vault, request, response, nullptr );
                         size_t                    count = 0;
 
                         if ( !limit ) {
@@ -645,7 +1119,7 @@ namespace token {
                           sort_field = sort_key[ 0 ];
                         }
 
-                        auto entries = manager->query( params[ "vault" ],
+                        auto entries = manager->query( vault,
                                                        uri->getQuery( "token" ),
                                                        uri->getQuery( "value" ),
                                                        expirations,
@@ -657,8 +1131,8 @@ namespace token {
 
                         for ( auto &entry : entries ) {
                           auto row = nlohmann::json::object( );
-                          Marshal( ).from( entry ).to( row );
-                          results.emplace_back( row );
+                          Marshal( ).from( std::move( entry ) ).to( row );
+                          results.emplace_back( std::move( row ) );
                         }
 
                         resp[ "offset" ]  = offset;
@@ -666,7 +1140,7 @@ namespace token {
                         resp[ "count" ]   = count;
                         resp[ "results" ] = results;
 
-                        response_set( response, resp );
+                        response_set( request, response, resp );
 
                         return true;
                       } );
@@ -678,10 +1152,11 @@ namespace token {
                         tracker< gauge_type >     reqtrack( *req_count );
                         tracker< histogram_type > dur_track( *resp_time );
                         auto                      resp = nlohmann::json::object( );
-                        Marshal{ manager->status( params[ "vault" ] ) }.to( resp );
-                        response_set( response, resp );
+                        Marshal{ manager->status( params[ "vault" ].to_string( ) ) }.to( resp );
+                        response_set( request, response, resp );
                         return true;
-                      } );
+                      },
+                      priority_type::high );
 
         service->get( "/status",
                       [ this ]( service_type::param_map_type &params,
@@ -691,9 +1166,10 @@ namespace token {
                         tracker< histogram_type > dur_track( *resp_time );
                         auto                      resp = nlohmann::json::object( );
                         Marshal{ manager->status( ) }.to( resp );
-                        response_set( response, resp );
+                        response_set( request, response, resp );
                         return true;
-                      } );
+                      },
+                      priority_type::high );
 
         service->get( "/metrics",
                       [ this ]( service_type::param_map_type &params,
@@ -704,12 +1180,22 @@ namespace token {
                         response.set( boost::beast::http::field::content_type, "text/plain" );
                         response.body( ) = prometheus::TextSerializer( ).Serialize( collected );
                         return true;
-                      } );
+                      },
+                      token::api::http::Dispatch::immediate );
       }
 
-      void response_set( service_type::response_type &response, nlohmann::json &json ) {
-        response.set( boost::beast::http::field::content_type, "application/json" );
-        response.body( ) = json.dump( 2 );
+      void response_set( service_type::request_type & request,
+                         service_type::response_type &response,
+                         nlohmann::json &             json ) {
+        auto encoding = encoder( request );
+
+        response.set( boost::beast::http::field::content_type, encoding.media( ) );
+
+        if ( pretty && encoding.is< token::api::marshal::json >( ) ) {
+          response.body( ) = json.dump( 2 );
+        } else {
+          encoding.dump( json, response.body( ) ); // Into the body's storage, see Session
+        }
 
         if ( json.find( "error" ) != json.end( ) ) {
           req_bad->Increment( );
@@ -722,6 +1208,11 @@ namespace token {
         service->start( );
         service->join( );
         executor->halt( );
+
+        for ( auto &vault : vaultExecutors ) {
+          vault.second->halt( );
+        }
+
         return 0;
       }
     }; // namespace app
@@ -12,7 +12,7 @@ BEGIN
     INTO config
     FROM user_limits_config ulc
    INNER JOIN user_vaults uv ON uv.id = ulc.uvault_id
-   INNER JOIN vaults      v  ON v.id  = uv.id
+   INNER JOIN vaults      v  ON v.id  = uv.vault
    WHERE uv.userid = _userid
      AND _vault IN ( v.alias, v.tablename );
 
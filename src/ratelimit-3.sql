@@ -0,0 +1,41 @@
+
+CREATE OR REPLACE FUNCTION user_limit_lease( _config_id integer, _requests integer ) RETURNS int AS $$
+DECLARE
+  config  user_limits_config%ROWTYPE;
+  granted integer;
+BEGIN
+  --
+  -- Reserve up to _requests from the current period in a single update,
+  -- starting a new period if the current one has expired
+  --
+  WITH cur AS (
+    SELECT ul.id,
+           CASE WHEN ul.expire < now( ) THEN ulc.value ELSE ul.value END           AS avail,
+           CASE WHEN ul.expire < now( ) THEN now( ) + ulc.period ELSE ul.expire END AS expire
+      FROM user_limits ul
+     INNER JOIN user_limits_config ulc ON ulc.id = ul.config_id
+     WHERE ul.config_id = _config_id
+       FOR UPDATE OF ul
+  )
+  UPDATE user_limits ul
+     SET value  = cur.avail - LEAST( cur.avail, _requests ),
+         expire = cur.expire
+    FROM cur
+   WHERE ul.id = cur.id
+  RETURNING LEAST( cur.avail, _requests ) INTO granted;
+
+  IF NOT FOUND THEN
+    SELECT * INTO config FROM user_limits_config WHERE id = _config_id;
+
+    IF NOT FOUND THEN
+      RETURN _requests;
+    END IF;
+
+    granted := LEAST( config.value, _requests );
+
+    INSERT INTO user_limits ( config_id, expire, value )
+    VALUES ( config.id, now( ) + config.period, config.value - granted );
+  END IF;
+
+  RETURN granted;
+END $$ LANGUAGE plpgsql;
@@ -0,0 +1,15 @@
+
+CREATE OR REPLACE FUNCTION user_limit_release( _config_id integer, _requests integer ) RETURNS int AS $$
+BEGIN
+  --
+  -- Hand back an unused reservation; only meaningful within the period it came from
+  --
+  UPDATE user_limits ul
+     SET value = LEAST( ul.value + _requests, ulc.value )
+    FROM user_limits_config ulc
+   WHERE ulc.id       = ul.config_id
+     AND ul.config_id = _config_id
+     AND ul.expire    > now( );
+
+  RETURN _requests;
+END $$ LANGUAGE plpgsql;
@@ -0,0 +1,13 @@
+
+CREATE OR REPLACE FUNCTION user_creds_id( _username varchar, _password varchar ) RETURNS int AS $$
+DECLARE
+  uid integer;
+BEGIN
+  SELECT id
+    INTO uid
+    FROM users
+   WHERE username = _username
+     AND password = encode( digest( _password, 'sha256' ), 'hex' );
+
+  RETURN COALESCE( uid, 0 );
+END $$ LANGUAGE plpgsql STABLE;
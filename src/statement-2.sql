@@ -0,0 +1,9 @@
+
+CREATE OR REPLACE FUNCTION user_token_id( _token varchar ) RETURNS int AS $$
+DECLARE
+  uid integer;
+BEGIN
+  SELECT id INTO uid FROM users WHERE token = _token;
+
+  RETURN COALESCE( uid, 0 );
+END $$ LANGUAGE plpgsql STABLE;
@@ -0,0 +1,9 @@
+
+CREATE OR REPLACE FUNCTION user_vault_access( _userid integer, _vault varchar ) RETURNS int AS $$
+BEGIN
+  RETURN CASE WHEN EXISTS ( SELECT 1
+                              FROM user_vaults uv
+                             INNER JOIN vaults v ON v.id = uv.vault
+                             WHERE uv.userid = _userid
+                               AND _vault IN ( v.alias, v.tablename ) ) THEN 1 ELSE 0 END;
+END $$ LANGUAGE plpgsql STABLE;
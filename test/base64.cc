@@ -0,0 +1,151 @@
+/* -*- Mode: c++ -*- */
+/*
+ * Decode round trip and rejection through each base64 path the CPU supports: the scalar
+ * decoder on its own, and the SSSE3 and AVX2 kernels finished by the scalar decoder.
+ */
+#include <base64.hh>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+  using namespace token::encoding::base64;
+
+  enum path_type { SCALAR, SSSE3, AVX2 };
+
+  const char *names[] = { "scalar", "ssse3", "avx2" };
+
+  std::string encode( const std::string &value ) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+
+    for ( size_t pos = 0; pos < value.size( ); pos += 3 ) {
+      uint32_t bits = uint8_t( value[ pos ] ) << 16;
+      size_t   n    = value.size( ) - pos;
+
+      bits |= ( n > 1 ) ? uint8_t( value[ pos + 1 ] ) << 8 : 0;
+      bits |= ( n > 2 ) ? uint8_t( value[ pos + 2 ] ) : 0;
+      result += alphabet[ ( bits >> 18 ) & 63 ];
+      result += alphabet[ ( bits >> 12 ) & 63 ];
+      result += ( n > 1 ) ? alphabet[ ( bits >> 6 ) & 63 ] : '=';
+      result += ( n > 2 ) ? alphabet[ bits & 63 ] : '=';
+    }
+
+    return result;
+  }
+
+  bool supported( path_type path ) {
+#if defined( TOKEN_BASE64_X86 )
+    switch ( path ) {
+      case SSSE3:
+        return __builtin_cpu_supports( "ssse3" );
+      case AVX2:
+        return __builtin_cpu_supports( "avx2" );
+      default:
+        return true;
+    }
+#else
+    return path == SCALAR;
+#endif
+  }
+
+  /**
+   * @brief Decode (unpadded) input through one path, as decode( ) would
+   * @return number of bytes decoded, or -1 if malformed
+   */
+  std::ptrdiff_t decode( path_type path, const std::string &in, std::vector< char > &out ) {
+    auto * src     = reinterpret_cast< const uint8_t * >( in.data( ) );
+    auto * dst     = reinterpret_cast< uint8_t * >( out.data( ) );
+    size_t len     = in.size( );
+    size_t done    = 0;
+    size_t written = 0;
+
+    while ( len && ( src[ len - 1 ] == '=' ) ) {
+      len--;
+    }
+
+#if defined( TOKEN_BASE64_X86 )
+    if ( path == SSSE3 ) {
+      done = detail::ssse3( src, len, dst, &written );
+    } else if ( path == AVX2 ) {
+      done = detail::avx2( src, len, dst, &written );
+    }
+#endif
+
+    std::ptrdiff_t rest = detail::scalar( src + done, len - done, dst + written );
+
+    return ( rest < 0 ) ? -1 : static_cast< std::ptrdiff_t >( written ) + rest;
+  }
+
+  int failures = 0;
+
+  void expect( bool ok, const char *what, path_type path, size_t size ) {
+    if ( !ok ) {
+      std::fprintf( stderr, "%s: %s failed for %zu bytes\n", names[ path ], what, size );
+      failures++;
+    }
+  }
+} // namespace
+
+int main( ) {
+  std::string value;
+
+  for ( size_t n = 0; n < 256; n++ ) {
+    value += char( ( n * 167 + 13 ) & 0xff );
+  }
+
+  for ( path_type path : { SCALAR, SSSE3, AVX2 } ) {
+    if ( !supported( path ) ) {
+      std::printf( "%s: not supported, skipped\n", names[ path ] );
+      continue;
+    }
+
+    for ( size_t size = 0; size <= value.size( ); size++ ) {
+      auto                encoded = encode( value.substr( 0, size ) );
+      std::vector< char > out( capacity( encoded.size( ) ) );
+      auto                n = decode( path, encoded, out );
+
+      expect( ( n == std::ptrdiff_t( size ) ) &&
+                  ( std::string( out.data( ), size ) == value.substr( 0, size ) ),
+              "round trip",
+              path,
+              size );
+
+      // A character outside the alphabet anywhere, in a vector block or the remainder
+      for ( size_t pos = 0; pos < encoded.size( ); pos += 7 ) {
+        for ( char bad : { '*', '-', '_', '\0', '\x80' } ) {
+          auto corrupt   = encoded;
+          corrupt[ pos ] = bad;
+
+          expect( decode( path, corrupt, out ) == -1, "rejection", path, size );
+        }
+      }
+    }
+
+    std::printf( "%s: ok\n", names[ path ] );
+  }
+
+  // The public entry point, padded and unpadded (256 bytes leave two '='), and a short buffer
+  auto                encoded = encode( value );
+  std::vector< char > out( capacity( encoded.size( ) ) );
+
+  expect( token::encoding::base64::decode( encoded.data( ), encoded.size( ), out.data( ),
+                                           out.size( ) ) == std::ptrdiff_t( value.size( ) ),
+          "decode",
+          SCALAR,
+          value.size( ) );
+  expect( token::encoding::base64::decode( encoded.data( ), encoded.size( ) - 2, out.data( ),
+                                           out.size( ) ) == std::ptrdiff_t( value.size( ) ),
+          "unpadded decode",
+          SCALAR,
+          value.size( ) );
+  expect( token::encoding::base64::decode( encoded.data( ), encoded.size( ), out.data( ),
+                                           out.size( ) - 1 ) == -1,
+          "short buffer",
+          SCALAR,
+          value.size( ) );
+
+  return failures ? 1 : 0;
+}